@@ -0,0 +1,589 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// What project mode reads from each translation unit, saved between runs: the
+// range of every function, the calls it makes and the variables it declares.
+// The file is a header followed by flat tables, each 8-byte aligned, that are
+// used straight from the mapping:
+//   files      path, modification time and size, and its range of functions
+//   functions  name, lines, whether static, and where its calls and symbols
+//              start; one extra entry past the last ends the ranges (CSR)
+//   calls      callee name and line
+//   symbols    name, type, declaration line and flags of each local variable
+//   strings    every name, NUL-terminated and stored once
+// Names are offsets into the string table. Files are sorted by path, as
+// loadCompileCommands lists them. A unit whose file still has the time and size
+// it was indexed with is copied from the old index, so a run after a small
+// change only lexes the files that changed.
+
+#define CALL_INDEX_MAGIC "BFINDEX"
+#define CALL_INDEX_VERSION 1
+
+typedef struct CallIndexHeader {
+    char magic[8];
+    int version;
+    int fileCount;
+    int functionCount;
+    int callCount;
+    int symbolCount;
+    int stringsSize;
+} CallIndexHeader;
+
+typedef struct IndexedFile {
+    long long mtime;         // Nanoseconds where the platform has them
+    long long size;
+    int path;
+    int functionStart;       // Its functions are functionStart .. + functionCount
+    int functionCount;
+    int reserved;
+} IndexedFile;
+
+typedef struct IndexedFunction {
+    int name;
+    int startLine;
+    int endLine;
+    int isStatic;
+    int callStart;           // Its calls run up to the next function's callStart
+    int symbolStart;         // Likewise its symbols
+} IndexedFunction;
+
+typedef struct IndexedCall {
+    int callee;
+    int line;
+} IndexedCall;
+
+#define SYMBOL_INITIALIZED 1
+#define SYMBOL_FREED 2
+
+typedef struct IndexedSymbol {
+    int name;
+    int type;
+    int line;
+    int flags;
+} IndexedSymbol;
+
+// A loaded index, or the tables of a CallIndexBuilder seen as one
+typedef struct CallIndex {
+    SourceFile source;       // The mapped file, if loaded from one
+    int loaded;
+    int fileCount;
+    int functionCount;
+    int callCount;
+    int symbolCount;
+    int stringsSize;
+    const IndexedFile* files;
+    const IndexedFunction* functions;  // functionCount + 1 entries
+    const IndexedCall* calls;
+    const IndexedSymbol* symbols;
+    const char* strings;
+} CallIndex;
+
+// Size of a table, rounded up to keep the next one aligned
+size_t indexTableSize(size_t count, size_t size) {
+    return (count * size + 7) & ~(size_t)7;
+}
+
+int validIndexString(const CallIndex* index, int offset) {
+    return offset >= 0 && offset < index->stringsSize;
+}
+
+// Whether every offset and range in the tables is in bounds, so that reading
+// the index needs no further checks.
+int validateCallIndex(const CallIndex* index) {
+    if (index->stringsSize > 0 && index->strings[index->stringsSize - 1] != '\0')
+        return 0;
+    int function = 0;
+    for (int f = 0; f < index->fileCount; f++) {
+        const IndexedFile* file = &index->files[f];
+        if (!validIndexString(index, file->path) || file->functionStart != function || file->functionCount < 0 ||
+            file->functionCount > index->functionCount - function)
+            return 0;
+        if (f > 0 && strcmp(index->strings + index->files[f - 1].path, index->strings + file->path) >= 0)
+            return 0;
+        function += file->functionCount;
+    }
+    if (function != index->functionCount)
+        return 0;
+    for (int i = 0; i <= index->functionCount; i++) {
+        const IndexedFunction* entry = &index->functions[i];
+        int callEnd = i < index->functionCount ? entry[1].callStart : index->callCount;
+        int symbolEnd = i < index->functionCount ? entry[1].symbolStart : index->symbolCount;
+        if (entry->callStart < 0 || entry->callStart > callEnd || entry->symbolStart < 0 ||
+            entry->symbolStart > symbolEnd)
+            return 0;
+        if (i < index->functionCount && !validIndexString(index, entry->name))
+            return 0;
+    }
+    if (index->functions[index->functionCount].callStart != index->callCount ||
+        index->functions[index->functionCount].symbolStart != index->symbolCount || index->functions[0].callStart != 0 ||
+        index->functions[0].symbolStart != 0)
+        return 0;
+    for (int i = 0; i < index->callCount; i++) {
+        if (!validIndexString(index, index->calls[i].callee))
+            return 0;
+    }
+    for (int i = 0; i < index->symbolCount; i++) {
+        if (!validIndexString(index, index->symbols[i].name) || !validIndexString(index, index->symbols[i].type))
+            return 0;
+    }
+    return 1;
+}
+
+const IndexedFunction emptyIndexFunctions[1];
+
+void initCallIndex(CallIndex* index) {
+    memset(index, 0, sizeof(CallIndex));
+    index->functions = emptyIndexFunctions;
+}
+
+// Maps the index at path. Returns 0, leaving index empty, if there is none or
+// it can't be used (another version, truncated, damaged).
+int openCallIndex(const char* path, CallIndex* index) {
+    initCallIndex(index);
+    SourceFile source;
+    if (!openSourceFile(path, &source))
+        return 0;
+    const CallIndexHeader* header = (const CallIndexHeader*)source.data;
+    int usable = source.size >= sizeof(CallIndexHeader) && memcmp(header->magic, CALL_INDEX_MAGIC, 8) == 0 &&
+                 header->version == CALL_INDEX_VERSION && header->fileCount >= 0 && header->functionCount >= 0 &&
+                 header->callCount >= 0 && header->symbolCount >= 0 && header->stringsSize >= 0;
+    size_t offsets[5];
+    if (usable) {
+        offsets[0] = sizeof(CallIndexHeader);
+        offsets[1] = offsets[0] + indexTableSize(header->fileCount, sizeof(IndexedFile));
+        offsets[2] = offsets[1] + indexTableSize(header->functionCount + 1, sizeof(IndexedFunction));
+        offsets[3] = offsets[2] + indexTableSize(header->callCount, sizeof(IndexedCall));
+        offsets[4] = offsets[3] + indexTableSize(header->symbolCount, sizeof(IndexedSymbol));
+        usable = offsets[4] + header->stringsSize == source.size;
+    }
+    if (!usable) {
+        closeSourceFile(&source);
+        return 0;
+    }
+    index->source = source;
+    index->loaded = 1;
+    index->fileCount = header->fileCount;
+    index->functionCount = header->functionCount;
+    index->callCount = header->callCount;
+    index->symbolCount = header->symbolCount;
+    index->stringsSize = header->stringsSize;
+    index->files = (const IndexedFile*)(source.data + offsets[0]);
+    index->functions = (const IndexedFunction*)(source.data + offsets[1]);
+    index->calls = (const IndexedCall*)(source.data + offsets[2]);
+    index->symbols = (const IndexedSymbol*)(source.data + offsets[3]);
+    index->strings = source.data + offsets[4];
+    if (!validateCallIndex(index)) {
+        closeSourceFile(&index->source);
+        initCallIndex(index);
+        return 0;
+    }
+    return 1;
+}
+
+void closeCallIndex(CallIndex* index) {
+    if (index->loaded)
+        closeSourceFile(&index->source);
+    initCallIndex(index);
+}
+
+const char* indexString(const CallIndex* index, int offset) {
+    return index->strings + offset;
+}
+
+// The entry of the file at path, or -1
+int findIndexedFile(const CallIndex* index, const char* path) {
+    int low = 0, high = index->fileCount - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        int order = strcmp(indexString(index, index->files[mid].path), path);
+        if (order == 0)
+            return mid;
+        if (order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -1;
+}
+
+// The modification time and size an entry for the file at path would record.
+// Returns 0 if the file can't be looked at.
+int stampIndexedFile(const char* path, long long* mtime, long long* size) {
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return 0;
+#ifdef __linux__
+    *mtime = (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#else
+    *mtime = (long long)info.st_mtime * 1000000000LL;
+#endif
+    *size = (long long)info.st_size;
+    return 1;
+}
+
+// Whether entry f is still what the file at path holds
+int indexedFileIsCurrent(const CallIndex* index, int f, const char* path) {
+    long long mtime, size;
+    return stampIndexedFile(path, &mtime, &size) && index->files[f].mtime == mtime && index->files[f].size == size;
+}
+
+// The call graph (unbuilt) and static functions of entry f, for mergeUnitCallGraph
+void readIndexedUnit(const CallIndex* index, int f, CallGraph** graph, CallGraph** statics) {
+    *graph = createCallGraph();
+    *statics = createCallGraph();
+    const IndexedFile* file = &index->files[f];
+    for (int i = file->functionStart; i < file->functionStart + file->functionCount; i++) {
+        const IndexedFunction* function = &index->functions[i];
+        const char* name = indexString(index, function->name);
+        int caller = getFunctionIndex(*graph, name);
+        if (function->isStatic)
+            getFunctionIndex(*statics, name);
+        for (int c = function->callStart; c < function[1].callStart; c++) {
+            const char* callee = indexString(index, index->calls[c].callee);
+            addCallSite(*graph, caller, callee, strlen(callee), index->calls[c].line);
+        }
+    }
+}
+
+// Tables being put together for a new index. Strings are interned through an
+// open-addressing table of their offsets.
+typedef struct CallIndexBuilder {
+    IndexedFile* files;
+    int fileCount;
+    int fileCapacity;
+    IndexedFunction* functions;
+    int functionCount;
+    int functionCapacity;
+    IndexedCall* calls;
+    int callCount;
+    int callCapacity;
+    IndexedSymbol* symbols;
+    int symbolCount;
+    int symbolCapacity;
+    char* strings;
+    int stringsSize;
+    int stringsCapacity;
+    int* slots;              // String offsets, -1 if free
+    int slotCapacity;        // Always a power of two
+    int stringCount;
+} CallIndexBuilder;
+
+CallIndexBuilder* createCallIndexBuilder() {
+    CallIndexBuilder* builder = (CallIndexBuilder*)calloc(1, sizeof(CallIndexBuilder));
+    if (builder == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    return builder;
+}
+
+void freeCallIndexBuilder(CallIndexBuilder* builder) {
+    free(builder->files);
+    free(builder->functions);
+    free(builder->calls);
+    free(builder->symbols);
+    free(builder->strings);
+    free(builder->slots);
+    free(builder);
+}
+
+int findIndexStringSlot(const CallIndexBuilder* builder, const char* text, int len) {
+    int mask = builder->slotCapacity - 1;
+    int slot = hashNameLength(text, len) & mask;
+    while (builder->slots[slot] != -1) {
+        const char* stored = builder->strings + builder->slots[slot];
+        if (strncmp(stored, text, len) == 0 && stored[len] == '\0')
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Offset of text in the string table, adding it the first time
+int internIndexString(CallIndexBuilder* builder, const char* text, int len) {
+    if ((builder->stringCount + 1) * 2 > builder->slotCapacity) {
+        int capacity = builder->slotCapacity ? builder->slotCapacity * 2 : 1024;
+        free(builder->slots);
+        builder->slots = (int*)malloc(sizeof(int) * capacity);
+        if (builder->slots == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        builder->slotCapacity = capacity;
+        memset(builder->slots, -1, sizeof(int) * capacity);
+        for (int offset = 0; offset < builder->stringsSize;) {
+            int length = strlen(builder->strings + offset);
+            builder->slots[findIndexStringSlot(builder, builder->strings + offset, length)] = offset;
+            offset += length + 1;
+        }
+    }
+    int slot = findIndexStringSlot(builder, text, len);
+    if (builder->slots[slot] != -1)
+        return builder->slots[slot];
+    builder->strings = (char*)growArray(builder->strings, &builder->stringsCapacity, builder->stringsSize + len + 1, 1);
+    memcpy(builder->strings + builder->stringsSize, text, len);
+    builder->strings[builder->stringsSize + len] = '\0';
+    builder->slots[slot] = builder->stringsSize;
+    builder->stringsSize += len + 1;
+    builder->stringCount++;
+    return builder->slots[slot];
+}
+
+int internIndexName(CallIndexBuilder* builder, const char* text) {
+    return internIndexString(builder, text, strlen(text));
+}
+
+// Starts the entry of a file; its functions follow with addIndexedFunction.
+void beginIndexedFile(CallIndexBuilder* builder, const char* path, long long mtime, long long size) {
+    builder->files = (IndexedFile*)growArray(builder->files, &builder->fileCapacity, builder->fileCount + 1,
+                                             sizeof(IndexedFile));
+    IndexedFile* file = &builder->files[builder->fileCount++];
+    memset(file, 0, sizeof(IndexedFile));
+    file->mtime = mtime;
+    file->size = size;
+    file->path = internIndexName(builder, path);
+    file->functionStart = builder->functionCount;
+}
+
+// Adds a function to the last file; its calls and symbols follow.
+void addIndexedFunction(CallIndexBuilder* builder, const char* name, int startLine, int endLine, int isStatic) {
+    builder->functions = (IndexedFunction*)growArray(builder->functions, &builder->functionCapacity,
+                                                     builder->functionCount + 2, sizeof(IndexedFunction));
+    IndexedFunction* function = &builder->functions[builder->functionCount++];
+    function->name = internIndexName(builder, name);
+    function->startLine = startLine;
+    function->endLine = endLine;
+    function->isStatic = isStatic;
+    function->callStart = builder->callCount;
+    function->symbolStart = builder->symbolCount;
+    builder->files[builder->fileCount - 1].functionCount++;
+}
+
+void addIndexedCall(CallIndexBuilder* builder, const char* callee, int line) {
+    builder->calls = (IndexedCall*)growArray(builder->calls, &builder->callCapacity, builder->callCount + 1,
+                                             sizeof(IndexedCall));
+    builder->calls[builder->callCount].callee = internIndexName(builder, callee);
+    builder->calls[builder->callCount].line = line;
+    builder->callCount++;
+}
+
+void addIndexedSymbol(CallIndexBuilder* builder, const char* name, const char* type, int line, int flags) {
+    builder->symbols = (IndexedSymbol*)growArray(builder->symbols, &builder->symbolCapacity, builder->symbolCount + 1,
+                                                 sizeof(IndexedSymbol));
+    IndexedSymbol* symbol = &builder->symbols[builder->symbolCount++];
+    symbol->name = internIndexName(builder, name);
+    symbol->type = internIndexName(builder, type);
+    symbol->line = line;
+    symbol->flags = flags;
+}
+
+// The builder's tables as an index. Valid until the builder changes.
+void viewCallIndex(CallIndexBuilder* builder, CallIndex* index) {
+    initCallIndex(index);
+    // The entry past the last function ends the last ranges
+    builder->functions = (IndexedFunction*)growArray(builder->functions, &builder->functionCapacity,
+                                                     builder->functionCount + 1, sizeof(IndexedFunction));
+    memset(&builder->functions[builder->functionCount], 0, sizeof(IndexedFunction));
+    builder->functions[builder->functionCount].callStart = builder->callCount;
+    builder->functions[builder->functionCount].symbolStart = builder->symbolCount;
+    index->fileCount = builder->fileCount;
+    index->functionCount = builder->functionCount;
+    index->callCount = builder->callCount;
+    index->symbolCount = builder->symbolCount;
+    index->stringsSize = builder->stringsSize;
+    index->files = builder->files;
+    index->functions = builder->functions;
+    index->calls = builder->calls;
+    index->symbols = builder->symbols;
+    index->strings = builder->strings;
+}
+
+// Copies entry f of index, an old index or another builder's, to the builder.
+void copyIndexedFile(CallIndexBuilder* builder, const CallIndex* index, int f) {
+    const IndexedFile* file = &index->files[f];
+    beginIndexedFile(builder, indexString(index, file->path), file->mtime, file->size);
+    for (int i = file->functionStart; i < file->functionStart + file->functionCount; i++) {
+        const IndexedFunction* function = &index->functions[i];
+        addIndexedFunction(builder, indexString(index, function->name), function->startLine, function->endLine,
+                           function->isStatic);
+        for (int c = function->callStart; c < function[1].callStart; c++)
+            addIndexedCall(builder, indexString(index, index->calls[c].callee), index->calls[c].line);
+        for (int s = function->symbolStart; s < function[1].symbolStart; s++) {
+            const IndexedSymbol* symbol = &index->symbols[s];
+            addIndexedSymbol(builder, indexString(index, symbol->name), indexString(index, symbol->type),
+                             symbol->line, symbol->flags);
+        }
+    }
+}
+
+// A definition of a unit's function, in source order
+typedef struct IndexedDefinition {
+    int function;            // In the unit's call graph
+    int startLine;
+    int endLine;
+} IndexedDefinition;
+
+// Indexes one lexed unit as the builder's next file. Functions are those of
+// readCallGraph, one per name, with the lines of their first definition; a
+// local variable belongs to the definition it is declared in.
+void indexLexedUnit(CallIndexBuilder* builder, const char* path, long long mtime, long long size,
+                    const LexedSource* lexed) {
+    CallGraph* graph = readCallGraph(lexed);
+    IndexedDefinition* definitions = NULL;
+    int definitionCount = 0, definitionCapacity = 0;
+    int* firstDefinition = (int*)malloc(sizeof(int) * (graph->funcCount + 1));
+    char* isStatic = (char*)calloc(graph->funcCount + 1, 1);
+    if (firstDefinition == NULL || isStatic == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (int f = 0; f < graph->funcCount; f++)
+        firstDefinition[f] = -1;
+    int next = 0, name, body, body_end;
+    while (nextFunctionDefinition(lexed, &next, &name, &body, &body_end)) {
+        const LexToken* token = &lexed->tokens[name];
+        int function = lookupFunctionIndex(graph, lexed->source.data + token->offset, token->length);
+        definitions = (IndexedDefinition*)growArray(definitions, &definitionCapacity, definitionCount + 1,
+                                                    sizeof(IndexedDefinition));
+        definitions[definitionCount].function = function;
+        definitions[definitionCount].startLine = token->line;
+        definitions[definitionCount].endLine = body_end < lexed->count ? lexed->tokens[body_end].line
+                                                                       : lexed->first_line + lexed->line_count - 1;
+        if (firstDefinition[function] == -1) {
+            firstDefinition[function] = definitionCount;
+            isStatic[function] = isStaticDefinition(lexed, name);
+        }
+        definitionCount++;
+    }
+
+    // The variables of every function, in declaration order; findings are not wanted here
+    FindingList found = {NULL, 0, 0};
+    FindingWriter* writer = (FindingWriter*)malloc(sizeof(FindingWriter));
+    if (writer == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    initFindingWriter(writer, NULL, OUTPUT_RECORD, path);
+    writer->records = &found;
+    FunctionInfo* functions = extractFunctionsFromTokens(lexed);
+    VariableTable* variables = extractVariablesFromTokens(lexed, functions, 1, writer);
+    freeFunctionList(functions);
+    freeFindingList(&found);
+    free(writer);
+
+    // Sort calls and symbols by function
+    int* callStart = (int*)calloc(graph->funcCount + 1, sizeof(int));
+    int* symbolStart = (int*)calloc(graph->funcCount + 1, sizeof(int));
+    int* callOrder = (int*)malloc(sizeof(int) * (graph->callCount + 1));
+    int symbolCapacity = variables->count + 1;
+    VariableInfo** symbolOrder = (VariableInfo**)malloc(sizeof(VariableInfo*) * symbolCapacity);
+    int* symbolFunction = (int*)malloc(sizeof(int) * symbolCapacity);
+    if (callStart == NULL || symbolStart == NULL || callOrder == NULL || symbolOrder == NULL || symbolFunction == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (int i = 0; i < graph->callCount; i++)
+        callStart[graph->calls[i].caller + 1]++;
+    int d = 0, symbolCount = 0;
+    for (VariableInfo* var = variables->head; var != NULL; var = var->next) {
+        while (d < definitionCount && definitions[d].endLine < var->declaration_line)
+            d++;
+        if (d == definitionCount || definitions[d].startLine > var->declaration_line)
+            continue; // File scope
+        symbolOrder[symbolCount] = var;
+        symbolFunction[symbolCount++] = definitions[d].function;
+        symbolStart[definitions[d].function + 1]++;
+    }
+    for (int f = 0; f < graph->funcCount; f++) {
+        callStart[f + 1] += callStart[f];
+        symbolStart[f + 1] += symbolStart[f];
+    }
+    int* fill = (int*)malloc(sizeof(int) * (graph->funcCount + 1));
+    VariableInfo** symbols = (VariableInfo**)malloc(sizeof(VariableInfo*) * symbolCapacity);
+    if (fill == NULL || symbols == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    memcpy(fill, callStart, sizeof(int) * (graph->funcCount + 1));
+    for (int i = 0; i < graph->callCount; i++)
+        callOrder[fill[graph->calls[i].caller]++] = i;
+    memcpy(fill, symbolStart, sizeof(int) * (graph->funcCount + 1));
+    for (int i = 0; i < symbolCount; i++)
+        symbols[fill[symbolFunction[i]]++] = symbolOrder[i];
+
+    beginIndexedFile(builder, path, mtime, size);
+    for (int f = 0; f < graph->funcCount; f++) {
+        IndexedDefinition* first = &definitions[firstDefinition[f]];
+        addIndexedFunction(builder, functionName(graph, f), first->startLine, first->endLine, isStatic[f]);
+        for (int c = callStart[f]; c < callStart[f + 1]; c++) {
+            const CallSite* call = &graph->calls[callOrder[c]];
+            addIndexedCall(builder, graph->calleePool + call->calleeOffset, call->call_line_number);
+        }
+        for (int s = symbolStart[f]; s < symbolStart[f + 1]; s++) {
+            VariableInfo* var = symbols[s];
+            addIndexedSymbol(builder, var->name, var->type, var->declaration_line,
+                             (var->is_initialized ? SYMBOL_INITIALIZED : 0) | (var->is_freed ? SYMBOL_FREED : 0));
+        }
+    }
+
+    free(fill);
+    free(symbols);
+    free(symbolOrder);
+    free(symbolFunction);
+    free(callOrder);
+    free(callStart);
+    free(symbolStart);
+    freeVariableTable(variables);
+    free(definitions);
+    free(firstDefinition);
+    free(isStatic);
+    freeCallGraph(graph);
+}
+
+// Writes the builder's tables to path, replacing any index there only once the
+// new one is complete. Returns 0 if it couldn't be written.
+int writeCallIndex(CallIndexBuilder* builder, const char* path) {
+    CallIndex index;
+    viewCallIndex(builder, &index);
+    CallIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CALL_INDEX_MAGIC, 8);
+    header.version = CALL_INDEX_VERSION;
+    header.fileCount = index.fileCount;
+    header.functionCount = index.functionCount;
+    header.callCount = index.callCount;
+    header.symbolCount = index.symbolCount;
+    header.stringsSize = index.stringsSize;
+
+    char* temporary = (char*)malloc(strlen(path) + 5);
+    if (temporary == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    sprintf(temporary, "%s.tmp", path);
+    FILE* out = fopen(temporary, "wb");
+    if (out == NULL) {
+        free(temporary);
+        return 0;
+    }
+    const char padding[8] = {0};
+    const void* tables[5] = {index.files, index.functions, index.calls, index.symbols, index.strings};
+    size_t sizes[5] = {index.fileCount * sizeof(IndexedFile), (index.functionCount + 1) * sizeof(IndexedFunction),
+                       index.callCount * sizeof(IndexedCall), index.symbolCount * sizeof(IndexedSymbol),
+                       (size_t)index.stringsSize};
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    for (int t = 0; t < 5 && ok; t++) {
+        size_t pad = t < 4 ? indexTableSize(sizes[t], 1) - sizes[t] : 0;
+        ok = (sizes[t] == 0 || fwrite(tables[t], 1, sizes[t], out) == sizes[t]) &&
+             (pad == 0 || fwrite(padding, 1, pad, out) == pad);
+    }
+    ok = fclose(out) == 0 && ok;
+    ok = ok && rename(temporary, path) == 0;
+    if (!ok)
+        remove(temporary);
+    free(temporary);
+    return ok;
+}
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// Reads the translation units of a project from its compilation database, the
+// compile_commands.json that CMake, Bear and others write: an array of objects
+// with the "directory" the compiler ran in and the "file" it compiled, relative
+// to that directory unless absolute. Only those two keys are looked at; the
+// others are skipped like any JSON value. A file compiled several times (with
+// different flags, say) is listed once.
+
+typedef struct CompileCommands {
+    char** files;            // Paths of the translation units, sorted
+    int count;
+    int capacity;
+} CompileCommands;
+
+typedef struct JsonReader {
+    const char* text;
+    size_t size;
+    size_t at;
+} JsonReader;
+
+void skipJsonSpace(JsonReader* reader) {
+    while (reader->at < reader->size && strchr(" \t\r\n", reader->text[reader->at]) != NULL)
+        reader->at++;
+}
+
+// Whether the next character, after any space, is c; consumes it if so.
+int readJsonChar(JsonReader* reader, char c) {
+    skipJsonSpace(reader);
+    if (reader->at < reader->size && reader->text[reader->at] == c) {
+        reader->at++;
+        return 1;
+    }
+    return 0;
+}
+
+void appendUtf8(char* out, int* len, unsigned code) {
+    if (code < 0x80) {
+        out[(*len)++] = (char)code;
+    } else if (code < 0x800) {
+        out[(*len)++] = (char)(0xC0 | code >> 6);
+        out[(*len)++] = (char)(0x80 | (code & 0x3F));
+    } else {
+        out[(*len)++] = (char)(0xE0 | code >> 12);
+        out[(*len)++] = (char)(0x80 | (code >> 6 & 0x3F));
+        out[(*len)++] = (char)(0x80 | (code & 0x3F));
+    }
+}
+
+// Reads a string, unescaped into a malloc'd buffer if value isn't NULL.
+// Returns 0 if there is no well-formed string next.
+int readJsonString(JsonReader* reader, char** value) {
+    if (!readJsonChar(reader, '"'))
+        return 0;
+    size_t start = reader->at;
+    while (reader->at < reader->size && reader->text[reader->at] != '"')
+        reader->at += reader->text[reader->at] == '\\' ? 2 : 1;
+    if (reader->at >= reader->size)
+        return 0;
+    size_t end = reader->at++;
+    if (value == NULL)
+        return 1;
+
+    // Escapes only ever shorten the text
+    char* out = (char*)malloc(end - start + 1);
+    if (out == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    int len = 0;
+    for (size_t i = start; i < end; i++) {
+        char c = reader->text[i];
+        if (c != '\\') {
+            out[len++] = c;
+            continue;
+        }
+        c = reader->text[++i];
+        switch (c) {
+            case 'b': out[len++] = '\b'; break;
+            case 'f': out[len++] = '\f'; break;
+            case 'n': out[len++] = '\n'; break;
+            case 'r': out[len++] = '\r'; break;
+            case 't': out[len++] = '\t'; break;
+            case 'u': {
+                unsigned code = 0;
+                int digits = 0;
+                while (digits < 4 && i + 1 < end && isxdigit((unsigned char)reader->text[i + 1])) {
+                    char h = reader->text[++i];
+                    code = code * 16 + (isdigit((unsigned char)h) ? h - '0' : (tolower((unsigned char)h) - 'a' + 10));
+                    digits++;
+                }
+                appendUtf8(out, &len, code);
+                break;
+            }
+            default: out[len++] = c; break;
+        }
+    }
+    out[len] = '\0';
+    *value = out;
+    return 1;
+}
+
+// Skips any value. Returns 0 if it isn't well-formed.
+int skipJsonValue(JsonReader* reader) {
+    skipJsonSpace(reader);
+    if (reader->at >= reader->size)
+        return 0;
+    char c = reader->text[reader->at];
+    if (c == '"')
+        return readJsonString(reader, NULL);
+    if (c == '{' || c == '[') {
+        char close = c == '{' ? '}' : ']';
+        reader->at++;
+        if (readJsonChar(reader, close))
+            return 1;
+        do {
+            if (c == '{' && (!readJsonString(reader, NULL) || !readJsonChar(reader, ':')))
+                return 0;
+            if (!skipJsonValue(reader))
+                return 0;
+        } while (readJsonChar(reader, ','));
+        return readJsonChar(reader, close);
+    }
+    // A number, true, false or null
+    size_t start = reader->at;
+    while (reader->at < reader->size && strchr(",}] \t\r\n", reader->text[reader->at]) == NULL)
+        reader->at++;
+    return reader->at > start;
+}
+
+void addCompileCommand(CompileCommands* commands, const char* directory, const char* file) {
+    char* path;
+    if (file[0] == '/' || directory == NULL || directory[0] == '\0') {
+        path = strdup(file);
+    } else {
+        path = (char*)malloc(strlen(directory) + strlen(file) + 2);
+        if (path != NULL)
+            sprintf(path, "%s%s%s", directory, directory[strlen(directory) - 1] == '/' ? "" : "/", file);
+    }
+    if (path == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    if (commands->count == commands->capacity) {
+        commands->capacity = commands->capacity ? commands->capacity * 2 : 64;
+        commands->files = (char**)realloc(commands->files, sizeof(char*) * commands->capacity);
+        if (commands->files == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+    }
+    commands->files[commands->count++] = path;
+}
+
+int compareCommandFiles(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+void freeCompileCommands(CompileCommands* commands) {
+    for (int i = 0; i < commands->count; i++)
+        free(commands->files[i]);
+    free(commands->files);
+    commands->files = NULL;
+    commands->count = commands->capacity = 0;
+}
+
+// Reads the compilation database at path into commands. Returns 0, with
+// nothing read, if the file can't be opened or isn't an array of objects.
+int loadCompileCommands(const char* path, CompileCommands* commands) {
+    memset(commands, 0, sizeof(CompileCommands));
+    SourceFile source;
+    if (!openSourceFile(path, &source))
+        return 0;
+    JsonReader reader = {source.data, source.size, 0};
+    int ok = readJsonChar(&reader, '[');
+    if (ok && !readJsonChar(&reader, ']')) {
+        do {
+            char* directory = NULL;
+            char* file = NULL;
+            ok = readJsonChar(&reader, '{');
+            if (ok && !readJsonChar(&reader, '}')) {
+                do {
+                    char* key = NULL;
+                    if (!readJsonString(&reader, &key) || !readJsonChar(&reader, ':')) {
+                        free(key);
+                        ok = 0;
+                        break;
+                    }
+                    char** value = strcmp(key, "directory") == 0 ? &directory
+                                 : strcmp(key, "file") == 0      ? &file
+                                                                 : NULL;
+                    free(key);
+                    if (value != NULL) {
+                        free(*value);
+                        *value = NULL;
+                    }
+                    ok = (value != NULL && readJsonString(&reader, value)) || skipJsonValue(&reader);
+                } while (ok && readJsonChar(&reader, ','));
+                ok = ok && readJsonChar(&reader, '}');
+            }
+            if (ok && file != NULL)
+                addCompileCommand(commands, directory, file);
+            free(directory);
+            free(file);
+        } while (ok && readJsonChar(&reader, ','));
+        ok = ok && readJsonChar(&reader, ']');
+    }
+    closeSourceFile(&source);
+    if (!ok) {
+        freeCompileCommands(commands);
+        return 0;
+    }
+
+    if (commands->count > 1)
+        qsort(commands->files, commands->count, sizeof(char*), compareCommandFiles);
+    int unique = 0;
+    for (int i = 0; i < commands->count; i++) {
+        if (unique > 0 && strcmp(commands->files[unique - 1], commands->files[i]) == 0) {
+            free(commands->files[i]);
+            continue;
+        }
+        commands->files[unique++] = commands->files[i];
+    }
+    commands->count = unique;
+    return 1;
+}
@@ -0,0 +1,372 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What a header declares that the detectors can use: the types it names with
+// typedef, the functions it declares or defines, which of those hand back memory
+// to be freed like malloc does, and which parameters a function may write
+// through. A source's DeclarationScope brings together the declarations of every
+// header it includes, directly or not; each header's are read once per run and
+// shared by every scope that includes it (HeaderCache.c). A source without a
+// scope sees no declarations, and the detectors work as they always have.
+
+#define DECLARES_TYPE 1
+#define DECLARES_FUNCTION 2
+#define DECLARES_ALLOCATOR 4     // A function returning memory the caller must free
+
+typedef struct Declaration {
+    int name;                    // Offset in the pool
+    int kinds;                   // DECLARES_ flags
+    unsigned int outParameters;  // Bit i: parameter i (of the first 32) points to non-const data
+} Declaration;
+
+// 4096 bits, two set per name, so that most lookups of names no header
+// declares are answered without probing any table
+#define DECLARATION_BLOOM_WORDS 64
+
+typedef struct Declarations {
+    Declaration* items;
+    int count;
+    int capacity;
+    char* pool;
+    int poolSize;
+    int poolCapacity;
+    int* slots;                  // Open addressing over items, -1 if free
+    int slotCapacity;            // Always a power of two
+    unsigned long long bloom[DECLARATION_BLOOM_WORDS];
+} Declarations;
+
+typedef struct DeclarationScope {
+    const Declarations** headers;  // In include order; the first to declare a name wins
+    int count;
+    int capacity;
+    unsigned long long bloom[DECLARATION_BLOOM_WORDS];  // Union of the headers'
+} DeclarationScope;
+
+void initDeclarations(Declarations* declarations) {
+    memset(declarations, 0, sizeof(Declarations));
+}
+
+void freeDeclarations(Declarations* declarations) {
+    free(declarations->items);
+    free(declarations->pool);
+    free(declarations->slots);
+    initDeclarations(declarations);
+}
+
+int bloomMayContain(const unsigned long long* bloom, unsigned int hash) {
+    unsigned int a = hash & 4095, b = (hash >> 12) & 4095;
+    return (bloom[a >> 6] >> (a & 63) & 1) && (bloom[b >> 6] >> (b & 63) & 1);
+}
+
+int findDeclarationSlot(const Declarations* declarations, const char* name, int len, unsigned int hash) {
+    int mask = declarations->slotCapacity - 1;
+    int slot = hash & mask;
+    while (declarations->slots[slot] != -1) {
+        const char* stored = declarations->pool + declarations->items[declarations->slots[slot]].name;
+        if (strncmp(stored, name, len) == 0 && stored[len] == '\0')
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+Declaration* findOwnDeclaration(const Declarations* declarations, const char* name, int len) {
+    unsigned int hash = hashNameLength(name, len);
+    if (declarations->count == 0 || !bloomMayContain(declarations->bloom, hash))
+        return NULL;
+    int slot = findDeclarationSlot(declarations, name, len, hash);
+    return declarations->slots[slot] == -1 ? NULL : &declarations->items[declarations->slots[slot]];
+}
+
+// Records that the header declares name as kinds. A name declared twice keeps
+// the parameters of its first function declaration.
+void addDeclaration(Declarations* declarations, const char* name, int len, int kinds, unsigned int outParameters) {
+    Declaration* existing = findOwnDeclaration(declarations, name, len);
+    if (existing != NULL) {
+        if (!(existing->kinds & DECLARES_FUNCTION))
+            existing->outParameters = outParameters;
+        existing->kinds |= kinds;
+        return;
+    }
+    if ((declarations->count + 1) * 2 > declarations->slotCapacity) {
+        int capacity = declarations->slotCapacity ? declarations->slotCapacity * 2 : 64;
+        free(declarations->slots);
+        declarations->slots = (int*)malloc(sizeof(int) * capacity);
+        if (declarations->slots == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        declarations->slotCapacity = capacity;
+        memset(declarations->slots, -1, sizeof(int) * capacity);
+        for (int i = 0; i < declarations->count; i++) {
+            const char* stored = declarations->pool + declarations->items[i].name;
+            int length = strlen(stored);
+            declarations->slots[findDeclarationSlot(declarations, stored, length, hashNameLength(stored, length))] = i;
+        }
+    }
+    if (declarations->count == declarations->capacity) {
+        declarations->capacity = declarations->capacity ? declarations->capacity * 2 : 32;
+        declarations->items = (Declaration*)realloc(declarations->items, sizeof(Declaration) * declarations->capacity);
+    }
+    if (declarations->poolSize + len + 1 > declarations->poolCapacity) {
+        while (declarations->poolSize + len + 1 > declarations->poolCapacity)
+            declarations->poolCapacity = declarations->poolCapacity ? declarations->poolCapacity * 2 : 512;
+        declarations->pool = (char*)realloc(declarations->pool, declarations->poolCapacity);
+    }
+    if (declarations->items == NULL || declarations->pool == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    unsigned int hash = hashNameLength(name, len);
+    Declaration* declaration = &declarations->items[declarations->count];
+    declaration->name = declarations->poolSize;
+    declaration->kinds = kinds;
+    declaration->outParameters = outParameters;
+    memcpy(declarations->pool + declarations->poolSize, name, len);
+    declarations->pool[declarations->poolSize + len] = '\0';
+    declarations->poolSize += len + 1;
+    declarations->slots[findDeclarationSlot(declarations, name, len, hash)] = declarations->count++;
+    unsigned int a = hash & 4095, b = (hash >> 12) & 4095;
+    declarations->bloom[a >> 6] |= 1ULL << (a & 63);
+    declarations->bloom[b >> 6] |= 1ULL << (b & 63);
+}
+
+// ---- Scopes ----
+
+void initDeclarationScope(DeclarationScope* scope) {
+    memset(scope, 0, sizeof(DeclarationScope));
+}
+
+void freeDeclarationScope(DeclarationScope* scope) {
+    free(scope->headers);
+    initDeclarationScope(scope);
+}
+
+void addScopeHeader(DeclarationScope* scope, const Declarations* declarations) {
+    if (scope->count == scope->capacity) {
+        scope->capacity = scope->capacity ? scope->capacity * 2 : 16;
+        scope->headers = (const Declarations**)realloc(scope->headers, sizeof(Declarations*) * scope->capacity);
+        if (scope->headers == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+    }
+    scope->headers[scope->count++] = declarations;
+    for (int w = 0; w < DECLARATION_BLOOM_WORDS; w++)
+        scope->bloom[w] |= declarations->bloom[w];
+}
+
+// What the scope's headers declare the name as, or NULL
+const Declaration* findDeclaration(const DeclarationScope* scope, const char* name, int len) {
+    if (scope == NULL || !bloomMayContain(scope->bloom, hashNameLength(name, len)))
+        return NULL;
+    for (int h = 0; h < scope->count; h++) {
+        const Declaration* declaration = findOwnDeclaration(scope->headers[h], name, len);
+        if (declaration != NULL)
+            return declaration;
+    }
+    return NULL;
+}
+
+// Whether token is an identifier the scope declares as one of kinds
+int scopeDeclares(const DeclarationScope* scope, const char* text, const LexToken* token, int kinds) {
+    if (scope == NULL || token->kind != LEX_IDENTIFIER)
+        return 0;
+    const Declaration* declaration = findDeclaration(scope, text + token->offset, token->length);
+    return declaration != NULL && (declaration->kinds & kinds) != 0;
+}
+
+// ---- Reading a header ----
+// Only file-scope declarations are looked at, one statement at a time; the
+// preprocessor is not run, so both branches of an #if count.
+
+int isAllocatorCall(const LexedSource* lexed, const Declarations* declarations, int i) {
+    const char* text = lexed->source.data;
+    const LexToken* token = &lexed->tokens[i];
+    if (token->kind != LEX_IDENTIFIER || i + 1 >= lexed->count || !isPunct(text, &lexed->tokens[i + 1], '('))
+        return 0;
+    if (tokenEquals(text, token, "malloc") || tokenEquals(text, token, "calloc") ||
+        tokenEquals(text, token, "realloc") || tokenEquals(text, token, "strdup"))
+        return 1;
+    const Declaration* declaration = findOwnDeclaration(declarations, text + token->offset, token->length);
+    return declaration != NULL && (declaration->kinds & DECLARES_ALLOCATOR);
+}
+
+// Whether a function body from body to body_end returns what an allocator
+// returned: "return malloc(...)", or "return p" where p was assigned one.
+int returnsAllocation(const LexedSource* lexed, const Declarations* declarations, int body, int body_end) {
+    const char* text = lexed->source.data;
+    const LexToken* assigned[8];
+    int assignedCount = 0;
+    int statement = body + 1;
+    for (int i = body + 1; i < body_end; i++) {
+        if (!isPunct(text, &lexed->tokens[i], ';') && !isPunct(text, &lexed->tokens[i], '{') &&
+            !isPunct(text, &lexed->tokens[i], '}'))
+            continue;
+        int allocates = 0;
+        for (int t = statement; t < i && !allocates; t++)
+            allocates = isAllocatorCall(lexed, declarations, t);
+        const LexToken* first = &lexed->tokens[statement];
+        if (statement < i && tokenEquals(text, first, "return")) {
+            if (allocates)
+                return 1;
+            for (int a = 0; a < assignedCount && i == statement + 2; a++) {
+                if (assigned[a]->length == lexed->tokens[statement + 1].length &&
+                    memcmp(text + assigned[a]->offset, text + lexed->tokens[statement + 1].offset,
+                           assigned[a]->length) == 0)
+                    return 1;
+            }
+        } else if (allocates && assignedCount < 8) {
+            // "p = malloc(...)" or "char* p = malloc(...)": the name before the first '='
+            for (int t = statement + 1; t < i; t++) {
+                if (isPunct(text, &lexed->tokens[t], '=')) {
+                    if (lexed->tokens[t - 1].kind == LEX_IDENTIFIER)
+                        assigned[assignedCount++] = &lexed->tokens[t - 1];
+                    break;
+                }
+            }
+        }
+        statement = i + 1;
+    }
+    return 0;
+}
+
+// Parameters from open to close that point to non-const data
+unsigned int readOutParameters(const LexedSource* lexed, int open, int close) {
+    const char* text = lexed->source.data;
+    unsigned int out = 0;
+    int parameter = 0, constant = 0, pointer = 0;
+    for (int i = open + 1; i <= close && parameter < 32; i++) {
+        const LexToken* token = &lexed->tokens[i];
+        if (i == close || isPunct(text, token, ',')) {
+            if (pointer)
+                out |= 1u << parameter;
+            parameter++;
+            constant = pointer = 0;
+        } else if (isPunct(text, token, '(') || isPunct(text, token, '[')) {
+            i = findClosingToken(lexed, i);  // A function pointer or array bound: not written through here
+        } else if (tokenEquals(text, token, "const") && !pointer) {
+            constant = 1;
+        } else if (isPunct(text, token, '*') && !constant) {
+            pointer = 1;
+        }
+    }
+    return out;
+}
+
+// "typedef ... NAME, *NAME2;": each declarator's name, the last identifier
+// outside brackets, or the one in "(*NAME)" for a pointer to function.
+void readTypedefNames(const LexedSource* lexed, Declarations* declarations, int from, int to) {
+    const char* text = lexed->source.data;
+    const LexToken* name = NULL;
+    for (int i = from; i <= to; i++) {
+        const LexToken* token = i < to ? &lexed->tokens[i] : NULL;
+        if (token == NULL || isPunct(text, token, ',')) {
+            if (name != NULL)
+                addDeclaration(declarations, text + name->offset, name->length, DECLARES_TYPE, 0);
+            name = NULL;
+        } else if (isPunct(text, token, '(') && i + 2 < to && isPunct(text, &lexed->tokens[i + 1], '*') &&
+                   lexed->tokens[i + 2].kind == LEX_IDENTIFIER) {
+            name = &lexed->tokens[i + 2];
+            i = findClosingToken(lexed, i);
+        } else if (isPunct(text, token, '(') || isPunct(text, token, '[') || isPunct(text, token, '{')) {
+            i = findClosingToken(lexed, i);
+        } else if (token->kind == LEX_IDENTIFIER) {
+            name = token;
+        }
+    }
+}
+
+// A function declaration or definition from from to to (its body from body to
+// body_end, or body is -1): "TYPE NAME(PARAMETERS)". An allocator returns a
+// pointer and is marked __attribute__((malloc)), is named like one (xmalloc,
+// pool_alloc) or, if defined here, returns what an allocator returned.
+void readFunctionDeclaration(const LexedSource* lexed, Declarations* declarations, int from, int to, int body,
+                             int body_end) {
+    const char* text = lexed->source.data;
+    int name = -1;
+    for (int i = from; i + 1 < to; i++) {
+        const LexToken* token = &lexed->tokens[i];
+        if (token->kind == LEX_IDENTIFIER && isPunct(text, &lexed->tokens[i + 1], '(')) {
+            if (tokenEquals(text, token, "__attribute__") || tokenEquals(text, token, "__declspec") ||
+                (i + 2 < to && isPunct(text, &lexed->tokens[i + 2], '*'))) {
+                i = findClosingToken(lexed, i + 1);
+                continue;
+            }
+            name = i;
+            break;
+        }
+        if (isPunct(text, token, '='))
+            return; // A variable, initialized
+        if (isPunct(text, token, '(') || isPunct(text, token, '[') || isPunct(text, token, '{'))
+            i = findClosingToken(lexed, i);
+    }
+    if (name <= from)
+        return; // No return type: a macro call, not a declaration
+    int close = findClosingToken(lexed, name + 1);
+    if (close >= to && body == -1)
+        return;
+
+    int pointer = 0, attributed = 0;
+    for (int i = from; i < to; i++) {
+        const LexToken* token = &lexed->tokens[i];
+        if (i < name && isPunct(text, token, '*'))
+            pointer = 1;
+        if ((i < name || i > close) && (tokenEquals(text, token, "malloc") || tokenEquals(text, token, "__malloc__") ||
+                                         tokenEquals(text, token, "__attribute_malloc__")))
+            attributed = 1;
+    }
+    const LexToken* token = &lexed->tokens[name];
+    int len = token->length;
+    const char* start = text + token->offset;
+    int allocName = len >= 5 && memcmp(start + len - 5, "alloc", 5) == 0 &&
+                    !(len >= 7 && memcmp(start + len - 7, "dealloc", 7) == 0);
+    int allocator = pointer && (attributed || allocName ||
+                                (body != -1 && returnsAllocation(lexed, declarations, body, body_end)));
+    addDeclaration(declarations, start, len, DECLARES_FUNCTION | (allocator ? DECLARES_ALLOCATOR : 0),
+                   readOutParameters(lexed, name + 1, close));
+}
+
+// Reads the file-scope declarations of a lexed header into declarations.
+void readDeclarations(const LexedSource* lexed, Declarations* declarations) {
+    const char* text = lexed->source.data;
+    for (int i = 0; i < lexed->count;) {
+        const LexToken* token = &lexed->tokens[i];
+        if (token->kind == LEX_DIRECTIVE || isPunct(text, token, ';') || isPunct(text, token, '}')) {
+            i++;
+            continue;
+        }
+        // extern "C" { ... } holds file-scope declarations too
+        if (tokenEquals(text, token, "extern") && i + 2 < lexed->count && lexed->tokens[i + 1].kind == LEX_STRING &&
+            isPunct(text, &lexed->tokens[i + 2], '{')) {
+            i += 3;
+            continue;
+        }
+        // The statement ends at ';' or, for a function definition, at its body
+        int end = i, body = -1;
+        while (end < lexed->count) {
+            const LexToken* at = &lexed->tokens[end];
+            if (isPunct(text, at, ';'))
+                break;
+            if (isPunct(text, at, '{') && end > i && isPunct(text, &lexed->tokens[end - 1], ')')) {
+                body = end;
+                break;
+            }
+            if (isPunct(text, at, '(') || isPunct(text, at, '[') || isPunct(text, at, '{')) {
+                end = findClosingToken(lexed, end) + 1;
+            } else {
+                end++;
+            }
+        }
+        if (end > lexed->count)
+            end = lexed->count;
+        int body_end = body != -1 ? findClosingToken(lexed, body) : -1;
+        if (tokenEquals(text, token, "typedef")) {
+            readTypedefNames(lexed, declarations, i + 1, end);
+        } else {
+            readFunctionDeclaration(lexed, declarations, i, end, body, body_end);
+        }
+        i = body != -1 ? body_end + 1 : end + 1;
+    }
+}
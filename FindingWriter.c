@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+
+// Streams findings out as soon as a detector produces them, in one of:
+//   text   the classic human-readable report (findings go straight to the stream)
+//   jsonl  one JSON object per line: file, line, rule, severity, message
+//   sarif  SARIF 2.1.0 results, wrapped by beginFindings/endFindings
+// or keeps them in memory (OUTPUT_RECORD) for the caller to write out later.
+// Machine formats are formatted into the writer's own buffer and written out in
+// large chunks, so memory for findings stays constant however many there are.
+
+typedef enum OutputFormat {
+    OUTPUT_TEXT,
+    OUTPUT_JSONL,
+    OUTPUT_SARIF,
+    OUTPUT_RECORD            // Appended to writer->records instead of written out
+} OutputFormat;
+
+typedef enum Severity {
+    SEVERITY_ERROR,
+    SEVERITY_WARNING
+} Severity;
+
+// A finding kept in memory, as OUTPUT_RECORD stores it
+typedef struct Finding {
+    Severity severity;
+    int line;
+    char* rule;
+    char* message;
+} Finding;
+
+typedef struct FindingList {
+    Finding* items;
+    int count;
+    int capacity;
+} FindingList;
+
+#define FINDING_BUFFER_SIZE 65536
+
+typedef struct FindingWriter {
+    FILE* out;
+    OutputFormat format;
+    const char* file;        // File the findings belong to
+    int count;               // Findings written so far
+    FindingList* records;    // Where OUTPUT_RECORD findings go
+    size_t used;
+    char buffer[FINDING_BUFFER_SIZE];
+} FindingWriter;
+
+void initFindingWriter(FindingWriter* writer, FILE* out, OutputFormat format, const char* file) {
+    writer->out = out;
+    writer->format = format;
+    writer->file = file;
+    writer->count = 0;
+    writer->records = NULL;
+    writer->used = 0;
+}
+
+void flushFindingWriter(FindingWriter* writer) {
+    if (writer->out == NULL)
+        return;
+    if (writer->used > 0) {
+        fwrite(writer->buffer, 1, writer->used, writer->out);
+        writer->used = 0;
+    }
+    fflush(writer->out);
+}
+
+char* copyString(const char* text) {
+    size_t len = strlen(text) + 1;
+    char* copy = (char*)malloc(len);
+    if (copy == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    memcpy(copy, text, len);
+    return copy;
+}
+
+void recordFinding(FindingList* list, Severity severity, const char* rule, int line, const char* message) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->items = (Finding*)realloc(list->items, sizeof(Finding) * list->capacity);
+        if (list->items == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+    }
+    Finding* finding = &list->items[list->count++];
+    finding->severity = severity;
+    finding->line = line;
+    finding->rule = copyString(rule);
+    finding->message = copyString(message);
+}
+
+void freeFindingList(FindingList* list) {
+    for (int i = 0; i < list->count; i++) {
+        free(list->items[i].rule);
+        free(list->items[i].message);
+    }
+    free(list->items);
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+void writeRaw(FindingWriter* writer, const char* text, size_t len) {
+    if (writer->used + len > FINDING_BUFFER_SIZE) {
+        fwrite(writer->buffer, 1, writer->used, writer->out);
+        writer->used = 0;
+        if (len > FINDING_BUFFER_SIZE) {
+            fwrite(text, 1, len, writer->out);
+            return;
+        }
+    }
+    memcpy(writer->buffer + writer->used, text, len);
+    writer->used += len;
+}
+
+void writeText(FindingWriter* writer, const char* text) {
+    writeRaw(writer, text, strlen(text));
+}
+
+void writeJsonString(FindingWriter* writer, const char* text) {
+    writeRaw(writer, "\"", 1);
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            char escaped[2] = {'\\', (char)*p};
+            writeRaw(writer, escaped, 2);
+        } else if (*p < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", *p);
+            writeRaw(writer, escaped, 6);
+        } else {
+            writeRaw(writer, (const char*)p, 1);
+        }
+    }
+    writeRaw(writer, "\"", 1);
+}
+
+// SARIF rule ids are conventionally identifiers: "Missing Semicolon" -> "missing-semicolon"
+void writeRuleId(FindingWriter* writer, const char* rule) {
+    char id[64];
+    int len = 0;
+    for (const char* p = rule; *p && len < (int)sizeof(id) - 1; p++) {
+        id[len++] = isspace((unsigned char)*p) ? '-' : (char)tolower((unsigned char)*p);
+    }
+    id[len] = '\0';
+    writeJsonString(writer, id);
+}
+
+void writeFinding(FindingWriter* writer, Severity severity, const char* rule, int line, const char* message) {
+    const char* level = severity == SEVERITY_ERROR ? "error" : "warning";
+    char number[16];
+    snprintf(number, sizeof(number), "%d", line);
+
+    switch (writer->format) {
+    case OUTPUT_TEXT:
+        fprintf(writer->out, "%s: %s\n", severity == SEVERITY_ERROR ? "Error" : "Warning", message);
+        break;
+    case OUTPUT_JSONL:
+        writeText(writer, "{\"file\":");
+        writeJsonString(writer, writer->file);
+        writeText(writer, ",\"line\":");
+        writeText(writer, number);
+        writeText(writer, ",\"rule\":");
+        writeJsonString(writer, rule);
+        writeText(writer, ",\"severity\":\"");
+        writeText(writer, level);
+        writeText(writer, "\",\"message\":");
+        writeJsonString(writer, message);
+        writeText(writer, "}\n");
+        break;
+    case OUTPUT_SARIF:
+        // Results of one writer are comma-separated here; when several writers'
+        // output is concatenated (batch mode) the caller separates the chunks
+        writeText(writer, writer->count > 0 ? ",\n        {\"ruleId\": " : "\n        {\"ruleId\": ");
+        writeRuleId(writer, rule);
+        writeText(writer, ", \"level\": \"");
+        writeText(writer, level);
+        writeText(writer, "\", \"message\": {\"text\": ");
+        writeJsonString(writer, message);
+        writeText(writer, "}, \"locations\": [{\"physicalLocation\": {\"artifactLocation\": {\"uri\": ");
+        writeJsonString(writer, writer->file);
+        writeText(writer, "}, \"region\": {\"startLine\": ");
+        writeText(writer, number);
+        writeText(writer, "}}}]}");
+        break;
+    case OUTPUT_RECORD:
+        recordFinding(writer->records, severity, rule, line, message);
+        break;
+    }
+    writer->count++;
+}
+
+// Writes out findings kept by an OUTPUT_RECORD writer, in the order they were found.
+void writeFindings(FindingWriter* writer, const FindingList* list) {
+    for (int i = 0; i < list->count; i++) {
+        Finding* finding = &list->items[i];
+        writeFinding(writer, finding->severity, finding->rule, finding->line, finding->message);
+    }
+}
+
+// Progress and error messages that are not findings. In text mode they are part
+// of the report; in the machine formats they go to stderr to keep stdout parseable.
+void writeMessage(FindingWriter* writer, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(writer->format == OUTPUT_TEXT ? writer->out : stderr, format, args);
+    va_end(args);
+}
+
+// SARIF needs a single document around all results.
+void beginFindings(FILE* out, OutputFormat format) {
+    if (format != OUTPUT_SARIF)
+        return;
+    fprintf(out,
+            "{\n"
+            "  \"$schema\": \"https://json.schemastore.org/sarif-2.1.0.json\",\n"
+            "  \"version\": \"2.1.0\",\n"
+            "  \"runs\": [\n"
+            "    {\n"
+            "      \"tool\": {\"driver\": {\"name\": \"Bug-Fixer\"}},\n"
+            "      \"results\": [");
+}
+
+void endFindings(FILE* out, OutputFormat format) {
+    if (format != OUTPUT_SARIF)
+        return;
+    fprintf(out, "\n      ]\n    }\n  ]\n}\n");
+}
+
+int parseOutputFormat(const char* name, OutputFormat* format) {
+    if (strcmp(name, "text") == 0) *format = OUTPUT_TEXT;
+    else if (strcmp(name, "jsonl") == 0) *format = OUTPUT_JSONL;
+    else if (strcmp(name, "sarif") == 0) *format = OUTPUT_SARIF;
+    else return 0;
+    return 1;
+}
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// Follows a source's #include directives to the headers it can find and gives
+// it the DeclarationScope of all of them (Declarations.c). "name" is looked for
+// next to the file that includes it, then on the search paths (-I); <name> only
+// on the search paths, so system headers are left alone unless a path names
+// them. Every header is read once per run, by the first thread to need it,
+// while any other thread that needs it meanwhile waits; from then on it is
+// shared. How a directive resolves is remembered too, so a run only looks for
+// each header on disk once per directory that includes it. There is no
+// preprocessor: every directive counts, whatever #if it is under, and one that
+// names its header through a macro is skipped.
+
+typedef enum HeaderState {
+    HEADER_UNREAD,
+    HEADER_READING,
+    HEADER_READY
+} HeaderState;
+
+typedef struct Header {
+    char* path;              // Real path, so one file is one header
+    HeaderState state;       // Under the cache lock; nothing below changes once ready
+    Declarations declarations;
+    struct Header** includes;  // The headers it includes that were found
+    int includeCount;
+    struct Header* next;     // In its hash bucket
+} Header;
+
+// Where a directive led: the header, or NULL if it wasn't found
+typedef struct IncludeResolution {
+    char* key;               // Quote, directory, name
+    Header* header;
+    struct IncludeResolution* next;
+} IncludeResolution;
+
+#define HEADER_BUCKETS 4096
+
+typedef struct HeaderCache {
+    char** searchPaths;
+    int searchPathCount;
+    Header* headers[HEADER_BUCKETS];
+    IncludeResolution* resolutions[HEADER_BUCKETS];
+    int headerCount;
+    int readCount;           // Headers read so far
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+} HeaderCache;
+
+HeaderCache* createHeaderCache() {
+    HeaderCache* cache = (HeaderCache*)calloc(1, sizeof(HeaderCache));
+    if (cache == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->ready, NULL);
+    return cache;
+}
+
+void addHeaderSearchPath(HeaderCache* cache, const char* directory) {
+    cache->searchPaths = (char**)realloc(cache->searchPaths, sizeof(char*) * (cache->searchPathCount + 1));
+    if (cache->searchPaths == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    cache->searchPaths[cache->searchPathCount++] = strdup(directory);
+}
+
+void freeHeaderCache(HeaderCache* cache) {
+    for (int b = 0; b < HEADER_BUCKETS; b++) {
+        while (cache->headers[b] != NULL) {
+            Header* header = cache->headers[b];
+            cache->headers[b] = header->next;
+            free(header->path);
+            freeDeclarations(&header->declarations);
+            free(header->includes);
+            free(header);
+        }
+        while (cache->resolutions[b] != NULL) {
+            IncludeResolution* resolution = cache->resolutions[b];
+            cache->resolutions[b] = resolution->next;
+            free(resolution->key);
+            free(resolution);
+        }
+    }
+    for (int i = 0; i < cache->searchPathCount; i++)
+        free(cache->searchPaths[i]);
+    free(cache->searchPaths);
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->ready);
+    free(cache);
+}
+
+// The header at a real path, added unread the first time. Call with the lock held.
+Header* findHeader(HeaderCache* cache, const char* path) {
+    Header** slot = &cache->headers[hashName(path) % HEADER_BUCKETS];
+    for (Header* header = *slot; header != NULL; header = header->next) {
+        if (strcmp(header->path, path) == 0)
+            return header;
+    }
+    Header* header = (Header*)calloc(1, sizeof(Header));
+    if (header == NULL || (header->path = strdup(path)) == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    initDeclarations(&header->declarations);
+    header->next = *slot;
+    *slot = header;
+    cache->headerCount++;
+    return header;
+}
+
+// The real path of directory/name (name alone if directory is NULL) if it is
+// a regular file, or NULL.
+char* findHeaderFile(const char* directory, const char* name, int len) {
+    char* candidate = (char*)malloc((directory != NULL ? strlen(directory) : 0) + len + 2);
+    if (candidate == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    if (directory != NULL) {
+        sprintf(candidate, "%s/%.*s", directory, len, name);
+    } else {
+        sprintf(candidate, "%.*s", len, name);
+    }
+    struct stat info;
+    char* path = NULL;
+    if (stat(candidate, &info) == 0 && S_ISREG(info.st_mode)) {
+#ifndef _WIN32
+        path = realpath(candidate, NULL);
+#endif
+        if (path == NULL)
+            path = strdup(candidate);
+    }
+    free(candidate);
+    return path;
+}
+
+// The header a directive in directory names, or NULL if it can't be found.
+Header* resolveInclude(HeaderCache* cache, const char* directory, const char* name, int len, int quoted) {
+    char* key = (char*)malloc(strlen(directory) + len + 3);
+    if (key == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    sprintf(key, "%c%s\n%.*s", quoted ? '"' : '<', directory, len, name);
+    IncludeResolution** slot = &cache->resolutions[hashName(key) % HEADER_BUCKETS];
+    pthread_mutex_lock(&cache->lock);
+    for (IncludeResolution* resolution = *slot; resolution != NULL; resolution = resolution->next) {
+        if (strcmp(resolution->key, key) == 0) {
+            pthread_mutex_unlock(&cache->lock);
+            free(key);
+            return resolution->header;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    // Looked for without the lock; two threads may both look, and the first to finish is kept
+    char* path = NULL;
+    if (name[0] == '/') {
+        path = findHeaderFile(NULL, name, len);
+    } else {
+        if (quoted)
+            path = findHeaderFile(directory, name, len);
+        for (int i = 0; path == NULL && i < cache->searchPathCount; i++)
+            path = findHeaderFile(cache->searchPaths[i], name, len);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    IncludeResolution* resolution = *slot;
+    while (resolution != NULL && strcmp(resolution->key, key) != 0)
+        resolution = resolution->next;
+    if (resolution == NULL) {
+        resolution = (IncludeResolution*)malloc(sizeof(IncludeResolution));
+        if (resolution == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        resolution->key = key;
+        resolution->header = path != NULL ? findHeader(cache, path) : NULL;
+        resolution->next = *slot;
+        *slot = resolution;
+        key = NULL;
+    }
+    Header* header = resolution->header;
+    pthread_mutex_unlock(&cache->lock);
+    free(key);
+    free(path);
+    return header;
+}
+
+// The directory of a file's path, "." for a bare name
+char* pathDirectory(const char* path) {
+    const char* slash = strrchr(path, '/');
+    if (slash == NULL)
+        return strdup(".");
+    if (slash == path)
+        return strdup("/");
+    char* directory = (char*)malloc(slash - path + 1);
+    if (directory == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    memcpy(directory, path, slash - path);
+    directory[slash - path] = '\0';
+    return directory;
+}
+
+// Adds the headers the directives of a lexed file (at path) name to includes.
+void resolveIncludes(HeaderCache* cache, const LexedSource* lexed, const char* path, Header*** includes, int* count) {
+    char* directory = pathDirectory(path);
+    int capacity = *count;
+    for (int i = 0; i < lexed->count; i++) {
+        const char* name;
+        int len, quoted;
+        if (!readIncludeDirective(lexed->source.data, &lexed->tokens[i], &name, &len, &quoted))
+            continue;
+        Header* header = resolveInclude(cache, directory, name, len, quoted);
+        if (header == NULL)
+            continue;
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            *includes = (Header**)realloc(*includes, sizeof(Header*) * capacity);
+            if (*includes == NULL) {
+                printf("Memory allocation failed!\n");
+                exit(1);
+            }
+        }
+        (*includes)[(*count)++] = header;
+    }
+    free(directory);
+}
+
+// Makes sure the header has been read: reads it, or waits while another thread does.
+void readHeader(HeaderCache* cache, Header* header) {
+    pthread_mutex_lock(&cache->lock);
+    while (header->state == HEADER_READING)
+        pthread_cond_wait(&cache->ready, &cache->lock);
+    if (header->state == HEADER_READY) {
+        pthread_mutex_unlock(&cache->lock);
+        return;
+    }
+    header->state = HEADER_READING;
+    pthread_mutex_unlock(&cache->lock);
+
+    Declarations declarations;
+    initDeclarations(&declarations);
+    Header** includes = NULL;
+    int includeCount = 0;
+    LexedSource lexed;
+    if (openLexedFile(header->path, &lexed)) {
+        readDeclarations(&lexed, &declarations);
+        resolveIncludes(cache, &lexed, header->path, &includes, &includeCount);
+        closeLexedSource(&lexed);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    header->declarations = declarations;
+    header->includes = includes;
+    header->includeCount = includeCount;
+    header->state = HEADER_READY;
+    cache->readCount++;
+    pthread_cond_broadcast(&cache->ready);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// A set of headers, for walking includes
+typedef struct HeaderSet {
+    Header** slots;
+    int capacity;            // Always a power of two
+    int count;
+} HeaderSet;
+
+// Adds header to the set; returns 0 if it was there already.
+int addToHeaderSet(HeaderSet* set, Header* header) {
+    if ((set->count + 1) * 2 > set->capacity) {
+        HeaderSet grown = {NULL, set->capacity ? set->capacity * 2 : 64, 0};
+        grown.slots = (Header**)calloc(grown.capacity, sizeof(Header*));
+        if (grown.slots == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        for (int i = 0; i < set->capacity; i++) {
+            if (set->slots[i] != NULL)
+                addToHeaderSet(&grown, set->slots[i]);
+        }
+        free(set->slots);
+        *set = grown;
+    }
+    int slot = (int)(((size_t)header >> 4) * 2654435761u) & (set->capacity - 1);
+    while (set->slots[slot] != NULL) {
+        if (set->slots[slot] == header)
+            return 0;
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    set->slots[slot] = header;
+    set->count++;
+    return 1;
+}
+
+typedef struct HeaderQueue {
+    Header** items;
+    int count;
+    int capacity;
+    HeaderSet seen;
+} HeaderQueue;
+
+void enqueueHeader(HeaderQueue* queue, Header* header) {
+    if (!addToHeaderSet(&queue->seen, header))
+        return;
+    if (queue->count == queue->capacity) {
+        queue->capacity = queue->capacity ? queue->capacity * 2 : 16;
+        queue->items = (Header**)realloc(queue->items, sizeof(Header*) * queue->capacity);
+        if (queue->items == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+    }
+    queue->items[queue->count++] = header;
+}
+
+// Calls visit for every header reachable from includes, first the ones
+// included directly, then what they include, and so on; each is read first.
+void walkHeaders(HeaderCache* cache, Header** includes, int count, void (*visit)(Header* header, void* context),
+                 void* context) {
+    HeaderQueue queue = {NULL, 0, 0, {NULL, 0, 0}};
+    for (int i = 0; i < count; i++)
+        enqueueHeader(&queue, includes[i]);
+    for (int q = 0; q < queue.count; q++) {
+        Header* header = queue.items[q];
+        readHeader(cache, header);
+        visit(header, context);
+        for (int i = 0; i < header->includeCount; i++)
+            enqueueHeader(&queue, header->includes[i]);
+    }
+    free(queue.items);
+    free(queue.seen.slots);
+}
+
+void addHeaderToScope(Header* header, void* context) {
+    if (header->declarations.count > 0)
+        addScopeHeader((DeclarationScope*)context, &header->declarations);
+}
+
+// The declarations a lexed file (at path) sees through its includes, which
+// are read as needed. Free with freeDeclarationScope.
+void openDeclarationScope(HeaderCache* cache, const LexedSource* lexed, const char* path, DeclarationScope* scope) {
+    initDeclarationScope(scope);
+    Header** includes = NULL;
+    int count = 0;
+    resolveIncludes(cache, lexed, path, &includes, &count);
+    walkHeaders(cache, includes, count, addHeaderToScope, scope);
+    free(includes);
+}
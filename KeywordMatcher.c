@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Keyword sets for lexed lines. Every pattern is a whole token (an identifier
+// like "return" or an operator like "+="), one bit of a mask; the patterns are
+// kept in an open-addressing hash table, so matching a line costs one lookup
+// per token however many keywords there are, and a keyword never matches part
+// of a longer identifier or anything inside a string or comment.
+
+#define MAX_KEYWORD_PATTERNS 64
+
+typedef struct KeywordMatcher {
+    const char** words;      // One slot per pattern, NULL when empty
+    uint64_t* masks;         // Patterns each slot's word stands for
+    int slot_count;          // Always a power of two
+    int pattern_count;
+} KeywordMatcher;
+
+unsigned int hashKeyword(const char* word, int len) {
+    unsigned int hash = 2166136261u; // FNV-1a
+    for (int i = 0; i < len; i++) {
+        hash ^= (unsigned char)word[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Returns the slot holding the word, or the empty slot where it would go
+int findKeywordSlot(const KeywordMatcher* matcher, const char* word, int len) {
+    unsigned int mask = matcher->slot_count - 1;
+    unsigned int i = hashKeyword(word, len) & mask;
+    while (matcher->words[i] != NULL) {
+        if (strncmp(matcher->words[i], word, len) == 0 && matcher->words[i][len] == '\0')
+            break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+KeywordMatcher* createKeywordMatcher(const char** patterns, int count) {
+    if (count > MAX_KEYWORD_PATTERNS) {
+        printf("Too many keyword patterns (%d), the limit is %d.\n", count, MAX_KEYWORD_PATTERNS);
+        exit(1);
+    }
+    KeywordMatcher* matcher = malloc(sizeof(KeywordMatcher));
+    if (!matcher) { printf("Memory allocation failed!\n"); exit(1); }
+    matcher->slot_count = 4 * MAX_KEYWORD_PATTERNS;
+    matcher->pattern_count = count;
+    matcher->words = calloc(matcher->slot_count, sizeof(const char*));
+    matcher->masks = calloc(matcher->slot_count, sizeof(uint64_t));
+    if (!matcher->words || !matcher->masks) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    // A word listed more than once stands for all of its patterns
+    for (int i = 0; i < count; i++) {
+        int slot = findKeywordSlot(matcher, patterns[i], strlen(patterns[i]));
+        matcher->words[slot] = patterns[i];
+        matcher->masks[slot] |= (uint64_t)1 << i;
+    }
+    return matcher;
+}
+
+// Returns the patterns the token's text is, as a mask.
+uint64_t matchToken(const KeywordMatcher* matcher, const char* text, const LexToken* token) {
+    if (token->kind != LEX_IDENTIFIER && token->kind != LEX_PUNCT)
+        return 0;
+    return matcher->masks[findKeywordSlot(matcher, text + token->offset, token->length)];
+}
+
+// Returns a mask with bit i set if patterns[i] is one of the line's tokens.
+uint64_t matchKeywords(const KeywordMatcher* matcher, const LexLine* line) {
+    uint64_t found = 0;
+    for (int i = 0; i < line->count; i++) {
+        found |= matchToken(matcher, line->text, &line->tokens[i]);
+    }
+    return found;
+}
+
+void freeKeywordMatcher(KeywordMatcher* matcher) {
+    if (matcher == NULL) {
+        return;
+    }
+    free(matcher->words);
+    free(matcher->masks);
+    free(matcher);
+}
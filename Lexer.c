@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// One pass of a C lexer over a whole SourceFile, producing the token array every
+// detector reads instead of raw lines: kind, offset, length and line of each
+// token. Whitespace and comments produce no tokens; a string or character
+// literal is one token, and so is a preprocessor directive with its
+// continuation lines, so no detector ever looks inside them. The buffer is only
+// read, never terminated in place, so a LexedSource can be shared by any
+// number of detectors.
+
+typedef enum LexKind {
+    LEX_IDENTIFIER,          // Identifiers and keywords
+    LEX_NUMBER,
+    LEX_STRING,
+    LEX_CHAR,
+    LEX_PUNCT,               // Operators and punctuation, longest match ("->", "<<=")
+    LEX_DIRECTIVE            // A whole preprocessor line, from the '#'
+} LexKind;
+
+typedef struct LexToken {
+    int offset;              // In the source buffer
+    int length;
+    int line;                // Line the token starts on
+    int kind;                // LexKind
+} LexToken;
+
+typedef struct LexedSource {
+    SourceFile source;       // Owned; tokens point into source.data
+    LexToken* tokens;
+    int count;
+    int capacity;
+    int first_line;
+    int line_count;
+    int* line_tokens;        // First token of each line, line_count + 1 entries
+    const struct DeclarationScope* declarations;  // What its headers declare, or NULL (Declarations.c)
+} LexedSource;
+
+// The tokens of one line
+typedef struct LexLine {
+    const char* text;        // The source buffer, for token text
+    const LexToken* tokens;
+    int count;
+    int number;
+    const struct DeclarationScope* declarations;  // The source's
+} LexLine;
+
+// Character classes for the lexer's inner loops
+enum {
+    CHAR_OTHER,
+    CHAR_SPACE,
+    CHAR_NEWLINE,
+    CHAR_IDENTIFIER,         // Letters, '_' and any byte of a UTF-8 sequence
+    CHAR_DIGIT
+};
+
+unsigned char lexClass[256];
+pthread_once_t lexClassOnce = PTHREAD_ONCE_INIT;
+
+void initLexClasses() {
+    for (int c = 0; c < 256; c++) {
+        if (c == '\n') lexClass[c] = CHAR_NEWLINE;
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v') lexClass[c] = CHAR_SPACE;
+        else if (c >= '0' && c <= '9') lexClass[c] = CHAR_DIGIT;
+        else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c >= 0x80) lexClass[c] = CHAR_IDENTIFIER;
+        else lexClass[c] = CHAR_OTHER;
+    }
+}
+
+// Length of the operator at p: "<<=", ">>=" and "..." of three characters; "->",
+// "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "##" and the
+// compound assignments of two; anything else is a single character.
+int punctLength(const char* p, const char* end) {
+    char first = p[0];
+    char second = end - p >= 2 ? p[1] : 0;
+    char third = end - p >= 3 ? p[2] : 0;
+    switch (first) {
+    case '<':
+    case '>':
+        if (second == first) return third == '=' ? 3 : 2;
+        return second == '=' ? 2 : 1;
+    case '.':
+        return second == '.' && third == '.' ? 3 : 1;
+    case '-':
+        return second == '>' || second == '-' || second == '=' ? 2 : 1;
+    case '+':
+    case '&':
+    case '|':
+        return second == first || second == '=' ? 2 : 1;
+    case '#':
+        return second == '#' ? 2 : 1;
+    case '=':
+    case '!':
+    case '*':
+    case '/':
+    case '%':
+    case '^':
+        return second == '=' ? 2 : 1;
+    }
+    return 1;
+}
+
+void addLexToken(LexedSource* lexed, int kind, const char* start, const char* end, int line) {
+    if (lexed->count == lexed->capacity) {
+        lexed->capacity = lexed->capacity ? lexed->capacity * 2 : 1024;
+        lexed->tokens = (LexToken*)realloc(lexed->tokens, sizeof(LexToken) * lexed->capacity);
+        if (lexed->tokens == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+    }
+    LexToken* token = &lexed->tokens[lexed->count++];
+    token->offset = (int)(start - lexed->source.data);
+    token->length = (int)(end - start);
+    token->line = line;
+    token->kind = kind;
+}
+
+// Skips a backslash-newline, counting the line. Returns the position after it,
+// or p if there is none.
+const char* skipContinuation(const char* p, const char* end, int* line) {
+    if (*p != '\\') return p;
+    const char* q = p + 1;
+    if (q < end && *q == '\r') q++;
+    if (q < end && *q == '\n') {
+        (*line)++;
+        return q + 1;
+    }
+    return p;
+}
+
+// Skips the inside of a block comment, counting its lines. Returns the position
+// of the closing "*/", or the end.
+const char* skipBlockComment(const char* p, const char* end, int* line) {
+    for (;;) {
+        while (p < end && *p != '*' && *p != '\n') p++;
+        if (p == end || (*p == '*' && p + 1 < end && p[1] == '/')) {
+            return p;
+        }
+        if (*p == '\n') (*line)++;
+        p++;
+    }
+}
+
+// Tokenizes the whole of source, which the LexedSource takes over.
+void lexSource(SourceFile* source, LexedSource* lexed) {
+    StatsMark mark = statsEnter(STAGE_LEXER);
+    pthread_once(&lexClassOnce, initLexClasses);
+    lexed->source = *source;
+    lexed->tokens = NULL;
+    lexed->count = 0;
+    lexed->capacity = 0;
+    lexed->first_line = source->first_line;
+    lexed->declarations = NULL;
+    if (source->size / 4 > 1024) {
+        lexed->capacity = (int)(source->size / 4);
+        lexed->tokens = (LexToken*)malloc(sizeof(LexToken) * lexed->capacity);
+        if (lexed->tokens == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+    }
+
+    const char* p = source->data;
+    const char* end = source->data + source->size;
+    int line = source->first_line;
+    int at_line_start = 1;   // Only whitespace and comments so far on this line
+
+    while (p < end) {
+        unsigned char c = (unsigned char)*p;
+        int cls = lexClass[c];
+        if (cls == CHAR_NEWLINE) {
+            line++;
+            at_line_start = 1;
+            p++;
+            continue;
+        }
+        if (cls == CHAR_SPACE) {
+            p++;
+            while (p < end && lexClass[(unsigned char)*p] == CHAR_SPACE) p++;
+            continue;
+        }
+        if (c == '/' && p + 1 < end && p[1] == '/') {
+            // To the end of the line, unless a backslash continues it
+            for (;;) {
+                while (p < end && *p != '\n' && *p != '\\') p++;
+                if (p == end || *p == '\n') break;
+                const char* next = skipContinuation(p, end, &line);
+                p = next != p ? next : p + 1;
+            }
+            continue;
+        }
+        if (c == '/' && p + 1 < end && p[1] == '*') {
+            p = skipBlockComment(p + 2, end, &line);
+            p = p + 2 < end ? p + 2 : end;
+            continue;
+        }
+
+        const char* start = p;
+        int token_line = line;
+        int kind;
+        if (c == '#' && at_line_start) {
+            kind = LEX_DIRECTIVE;
+            for (;;) {
+                while (p < end && *p != '\n' && *p != '/' && *p != '\\') p++;
+                if (p == end || *p == '\n') break;
+                if (*p == '/' && p + 1 < end && p[1] == '/') break;
+                if (*p == '/' && p + 1 < end && p[1] == '*') {
+                    // A comment inside a directive may run over several lines
+                    p = skipBlockComment(p + 2, end, &line);
+                    p = p + 2 < end ? p + 2 : end;
+                    continue;
+                }
+                const char* next = skipContinuation(p, end, &line);
+                p = next != p ? next : p + 1;
+            }
+            const char* token_end = p;
+            while (token_end > start && lexClass[(unsigned char)token_end[-1]] == CHAR_SPACE) token_end--;
+            addLexToken(lexed, kind, start, token_end, token_line);
+            continue;
+        } else if (cls == CHAR_IDENTIFIER) {
+            kind = LEX_IDENTIFIER;
+            while (p < end && (lexClass[(unsigned char)*p] == CHAR_IDENTIFIER || lexClass[(unsigned char)*p] == CHAR_DIGIT)) p++;
+        } else if (cls == CHAR_DIGIT || (c == '.' && p + 1 < end && lexClass[(unsigned char)p[1]] == CHAR_DIGIT)) {
+            // A preprocessing number: digits, letters, '.', and signs after an exponent
+            kind = LEX_NUMBER;
+            p++;
+            while (p < end) {
+                int next = lexClass[(unsigned char)*p];
+                if ((*p == '+' || *p == '-') && (p[-1] == 'e' || p[-1] == 'E' || p[-1] == 'p' || p[-1] == 'P')) p++;
+                else if (next == CHAR_IDENTIFIER || next == CHAR_DIGIT || *p == '.') p++;
+                else break;
+            }
+        } else if (c == '"' || c == '\'') {
+            // Ends at the closing quote, or unterminated at the end of the line
+            kind = c == '"' ? LEX_STRING : LEX_CHAR;
+            p++;
+            for (;;) {
+                while (p < end && *p != (char)c && *p != '\n' && *p != '\\') p++;
+                if (p == end || *p != '\\') break;
+                if (p + 1 < end) {
+                    const char* next = skipContinuation(p, end, &line);
+                    p = next != p ? next : p + 2;
+                } else {
+                    p++;
+                }
+            }
+            if (p < end && *p == (char)c) p++;
+        } else {
+            kind = LEX_PUNCT;
+            p += punctLength(p, end);
+        }
+        addLexToken(lexed, kind, start, p, token_line);
+        at_line_start = 0;
+    }
+
+    // Lines are counted as nextLine hands them out: a final newline does not start another line
+    lexed->line_count = line - source->first_line;
+    if (source->size > 0 && source->data[source->size - 1] != '\n') {
+        lexed->line_count++;
+    }
+    lexed->line_tokens = (int*)malloc(sizeof(int) * (lexed->line_count + 2));
+    if (lexed->line_tokens == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    int t = 0;
+    for (int i = 0; i <= lexed->line_count; i++) {
+        while (t < lexed->count && lexed->tokens[t].line < lexed->first_line + i) t++;
+        lexed->line_tokens[i] = t;
+    }
+    statsLeave(mark, lexed->line_count);
+}
+
+// Returns 0 if the file can't be opened.
+int openLexedFile(const char* filename, LexedSource* lexed) {
+    SourceFile source;
+    if (!openSourceFile(filename, &source)) {
+        return 0;
+    }
+    lexSource(&source, lexed);
+    return 1;
+}
+
+// Tokenizes a private copy of text, numbering its lines from first_line.
+void lexCopy(LexedSource* lexed, const char* text, size_t size, int first_line) {
+    SourceFile source;
+    openSourceCopy(&source, text, size, first_line);
+    lexSource(&source, lexed);
+}
+
+void closeLexedSource(LexedSource* lexed) {
+    closeSourceFile(&lexed->source);
+    free(lexed->tokens);
+    free(lexed->line_tokens);
+    lexed->tokens = NULL;
+    lexed->line_tokens = NULL;
+    lexed->count = 0;
+}
+
+// The tokens of the index-th line (counting from 0).
+void getLexLine(const LexedSource* lexed, int index, LexLine* line) {
+    int first = lexed->line_tokens[index];
+    line->text = lexed->source.data;
+    line->tokens = lexed->tokens + first;
+    line->count = lexed->line_tokens[index + 1] - first;
+    line->number = lexed->first_line + index;
+    line->declarations = lexed->declarations;
+}
+
+int tokenEquals(const char* text, const LexToken* token, const char* word) {
+    int len = (int)strlen(word);
+    return token->length == len && memcmp(text + token->offset, word, len) == 0;
+}
+
+unsigned int hashNameLength(const char* name, int len) {
+    unsigned int hash = 2166136261u; // FNV-1a
+    for (int i = 0; i < len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+unsigned int hashName(const char* name) {
+    return hashNameLength(name, strlen(name));
+}
+
+// Whether token is the single-character punctuator c.
+int isPunct(const char* text, const LexToken* token, char c) {
+    return token->kind == LEX_PUNCT && token->length == 1 && text[token->offset] == c;
+}
+
+// Copies the token's text into buffer, or returns NULL if it doesn't fit.
+char* copyTokenText(const char* text, const LexToken* token, char* buffer, int size) {
+    if (token->length >= size) {
+        return NULL;
+    }
+    memcpy(buffer, text + token->offset, token->length);
+    buffer[token->length] = '\0';
+    return buffer;
+}
+
+// The header an #include directive names: sets *name and *len to the text
+// between the quotes or angle brackets and *quoted to whether it was "name".
+// Returns 0 for any other directive, or an #include of a macro.
+int readIncludeDirective(const char* text, const LexToken* token, const char** name, int* len, int* quoted) {
+    if (token->kind != LEX_DIRECTIVE)
+        return 0;
+    const char* p = text + token->offset + 1;
+    const char* end = text + token->offset + token->length;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    if (end - p < 7 || memcmp(p, "include", 7) != 0)
+        return 0;
+    p += 7;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    if (p == end || (*p != '"' && *p != '<'))
+        return 0;
+    char close = *p == '"' ? '"' : '>';
+    const char* start = ++p;
+    while (p < end && *p != close && *p != '\n')
+        p++;
+    if (p == end || *p != close || p == start)
+        return 0;
+    *name = start;
+    *len = (int)(p - start);
+    *quoted = close == '"';
+    return 1;
+}
+
+// Index of the bracket closing the one at open, or the token count if it is never closed.
+int findClosingToken(const LexedSource* lexed, int open) {
+    const char* text = lexed->source.data;
+    char opening = text[lexed->tokens[open].offset];
+    char closing = opening == '(' ? ')' : (opening == '[' ? ']' : '}');
+    int depth = 0;
+    for (int i = open; i < lexed->count; i++) {
+        if (isPunct(text, &lexed->tokens[i], opening)) {
+            depth++;
+        } else if (isPunct(text, &lexed->tokens[i], closing) && --depth == 0) {
+            return i;
+        }
+    }
+    return lexed->count;
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Whole-file input for the detectors. The file is mapped (or read in one go
+// where mapping isn't possible) into a private buffer and handed out as line
+// views that point straight into it, so lines are never copied and have no
+// length limit. Each view is NUL-terminated in place, over its newline, so the
+// usual string functions work on it; the newline itself is not part of the view.
+
+typedef struct SourceFile {
+    char* data;
+    size_t size;
+    size_t mapped;           // Length of the mapping, or 0 if data was malloc'd
+    size_t offset;           // Start of the next line
+    int first_line;          // Number of the first line, 1 unless this is part of a file
+} SourceFile;
+
+typedef struct LineView {
+    char* text;              // Points into the SourceFile, NUL-terminated
+    int length;
+    int newline;             // Whether the line ended in a newline (the last one may not)
+} LineView;
+
+int readSourceFile(FILE* file, SourceFile* source) {
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    if (size < 0) {
+        return 0;
+    }
+    source->data = (char*)malloc((size_t)size + 1);
+    if (source->data == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    source->size = fread(source->data, 1, (size_t)size, file);
+    source->data[source->size] = '\0';
+    return 1;
+}
+
+// Returns 0 if the file can't be opened.
+int openSourceFile(const char* filename, SourceFile* source) {
+    source->data = NULL;
+    source->size = 0;
+    source->mapped = 0;
+    source->offset = 0;
+    source->first_line = 1;
+
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        size_t size = (size_t)info.st_size;
+        long page = sysconf(_SC_PAGESIZE);
+        // The bytes after the end of the file in its last page read as zero, which
+        // terminates the last line. A file that fills its last page exactly has no
+        // such byte, so it is read instead.
+        if (page > 0 && size % (size_t)page != 0) {
+            void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                close(fd);
+                source->data = (char*)data;
+                source->size = size;
+                source->mapped = size;
+                return 1;
+            }
+        }
+    }
+    close(fd);
+#endif
+
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    int ok = readSourceFile(file, source);
+    fclose(file);
+    return ok;
+}
+
+// Wraps a private copy of text, e.g. one function cut out of a file, numbering
+// its lines from first_line.
+void openSourceCopy(SourceFile* source, const char* text, size_t size, int first_line) {
+    source->data = (char*)malloc(size + 1);
+    if (source->data == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    memcpy(source->data, text, size);
+    source->data[size] = '\0';
+    source->size = size;
+    source->mapped = 0;
+    source->offset = 0;
+    source->first_line = first_line;
+}
+
+// Hands out the next line, or returns 0 at the end of the file. Like fgets, a
+// final newline does not start another (empty) line.
+int nextLine(SourceFile* source, LineView* line) {
+    if (source->offset >= source->size) {
+        return 0;
+    }
+    char* start = source->data + source->offset;
+    char* end = (char*)memchr(start, '\n', source->size - source->offset);
+    line->newline = end != NULL;
+    if (end == NULL) {
+        end = source->data + source->size; // Already NUL
+    }
+    *end = '\0';
+    line->text = start;
+    line->length = (int)(end - start);
+    source->offset = end - source->data + 1;
+    return 1;
+}
+
+void closeSourceFile(SourceFile* source) {
+#ifndef _WIN32
+    if (source->mapped > 0) {
+        munmap(source->data, source->mapped);
+        source->data = NULL;
+        return;
+    }
+#endif
+    free(source->data);
+    source->data = NULL;
+}
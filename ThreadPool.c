@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+// Work-stealing thread pool for independent tasks numbered 0 .. taskCount - 1.
+// Tasks are dealt round-robin into one queue per worker. A worker takes from
+// the back of its own queue and, once that is empty, steals from the front of
+// the other workers' queues, so a few slow tasks don't leave cores idle.
+// Needs -pthread when compiling.
+
+typedef void (*TaskFunction)(int task, int worker, void* context);
+
+typedef struct WorkQueue {
+    int* tasks;
+    int head;                // Next task a thief takes
+    int tail;                // One past the next task the owner takes
+    pthread_mutex_t lock;
+} WorkQueue;
+
+typedef struct TaskPool {
+    WorkQueue* queues;
+    pthread_t* threads;
+    int workerCount;
+    TaskFunction run;
+    void* context;
+} TaskPool;
+
+typedef struct PoolWorker {
+    TaskPool* pool;
+    int id;
+} PoolWorker;
+
+int popOwnTask(WorkQueue* queue) {
+    int task = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+        task = queue->tasks[--queue->tail];
+    pthread_mutex_unlock(&queue->lock);
+    return task;
+}
+
+int stealTask(WorkQueue* queue) {
+    int task = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+        task = queue->tasks[queue->head++];
+    pthread_mutex_unlock(&queue->lock);
+    return task;
+}
+
+void* poolWorkerMain(void* arg) {
+    PoolWorker* worker = (PoolWorker*)arg;
+    TaskPool* pool = worker->pool;
+    for (;;) {
+        int task = popOwnTask(&pool->queues[worker->id]);
+        // No tasks are ever added after start, so once every queue is empty we're done
+        for (int i = 1; task == -1 && i < pool->workerCount; i++)
+            task = stealTask(&pool->queues[(worker->id + i) % pool->workerCount]);
+        if (task == -1)
+            break;
+        pool->run(task, worker->id, pool->context);
+    }
+    free(worker);
+    return NULL;
+}
+
+// Starts workerCount threads running run(task, worker, context) for every task.
+// Tasks are queued in reverse so each worker starts on its lowest-numbered task.
+TaskPool* startTaskPool(int taskCount, int workerCount, TaskFunction run, void* context) {
+    if (workerCount < 1)
+        workerCount = 1;
+    TaskPool* pool = (TaskPool*)malloc(sizeof(TaskPool));
+    if (pool == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    pool->workerCount = workerCount;
+    pool->run = run;
+    pool->context = context;
+    pool->queues = (WorkQueue*)malloc(sizeof(WorkQueue) * workerCount);
+    pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * workerCount);
+    if (pool->queues == NULL || pool->threads == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+
+    for (int w = 0; w < workerCount; w++) {
+        WorkQueue* queue = &pool->queues[w];
+        queue->tasks = (int*)malloc(sizeof(int) * (taskCount / workerCount + 1));
+        if (queue->tasks == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        queue->head = 0;
+        queue->tail = 0;
+        pthread_mutex_init(&queue->lock, NULL);
+    }
+    for (int task = taskCount - 1; task >= 0; task--) {
+        WorkQueue* queue = &pool->queues[task % workerCount];
+        queue->tasks[queue->tail++] = task;
+    }
+
+    for (int w = 0; w < workerCount; w++) {
+        PoolWorker* worker = (PoolWorker*)malloc(sizeof(PoolWorker));
+        if (worker == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        worker->pool = pool;
+        worker->id = w;
+        if (pthread_create(&pool->threads[w], NULL, poolWorkerMain, worker) != 0) {
+            printf("Could not start worker thread.\n");
+            exit(1);
+        }
+    }
+    return pool;
+}
+
+// Waits for every task to finish and frees the pool.
+void finishTaskPool(TaskPool* pool) {
+    for (int w = 0; w < pool->workerCount; w++)
+        pthread_join(pool->threads[w], NULL);
+    for (int w = 0; w < pool->workerCount; w++) {
+        pthread_mutex_destroy(&pool->queues[w].lock);
+        free(pool->queues[w].tasks);
+    }
+    free(pool->queues);
+    free(pool->threads);
+    free(pool);
+}
@@ -10,13 +10,28 @@ typedef struct VariableInfo {
     int is_initialized;
     int is_freed;
     int freed_line; // Line number where freed, 0 if not freed
-    struct VariableInfo* next;
+    unsigned int hash;       // Hash of name, kept to skip most strcmp calls
+    int order;               // Position in declaration order
+    int seen_line;           // Last line a per-line check picked this variable out of
+    struct VariableInfo* next; // Next variable in declaration order
 } VariableInfo;
 
+// Symbol table: variables are chained in insertion order for display, and indexed
+// by an open-addressing hash table (linear probing) for O(1) average lookup.
+typedef struct VariableTable {
+    VariableInfo* head;
+    VariableInfo* tail;
+    VariableInfo** slots;
+    int capacity;            // Always a power of two
+    int count;
+    int freed_count;         // Pointers currently freed
+} VariableTable;
+
 typedef struct FunctionInfo {
     char name[50];           // Function name
     int start_line;          // Line where function starts
     int end_line;            // Line where function ends
+    int scan_token;          // Token the definition scan finds it from, -1 if unknown
     struct FunctionInfo* next;
 } FunctionInfo;
 
@@ -33,265 +48,375 @@ VariableInfo* createVariableInfo(char* name, char* type, int line, int initializ
     newVar->is_initialized = initialized;
     newVar->is_freed = 0;
     newVar->freed_line = 0;
+    newVar->hash = hashName(name);
+    newVar->order = 0;
+    newVar->seen_line = 0;
     newVar->next = NULL;
     
     return newVar;
 }
-void addVariable(VariableInfo** head, char* name, char* type, int line, int initialized) {
+
+VariableTable* createVariableTable() {
+    VariableTable* table = (VariableTable*)malloc(sizeof(VariableTable));
+    if (table == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    table->head = NULL;
+    table->tail = NULL;
+    table->count = 0;
+    table->freed_count = 0;
+    table->capacity = 16;
+    table->slots = (VariableInfo**)calloc(table->capacity, sizeof(VariableInfo*));
+    if (table->slots == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    return table;
+}
+
+void insertVariableSlot(VariableInfo** slots, int capacity, VariableInfo* var) {
+    unsigned int mask = capacity - 1;
+    unsigned int i = var->hash & mask;
+    while (slots[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = var;
+}
+
+void growVariableTable(VariableTable* table) {
+    int new_capacity = table->capacity * 2;
+    VariableInfo** new_slots = (VariableInfo**)calloc(new_capacity, sizeof(VariableInfo*));
+    if (new_slots == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (VariableInfo* var = table->head; var != NULL; var = var->next) {
+        insertVariableSlot(new_slots, new_capacity, var);
+    }
+    free(table->slots);
+    table->slots = new_slots;
+    table->capacity = new_capacity;
+}
+
+VariableInfo* addVariable(VariableTable* table, char* name, char* type, int line, int initialized) {
     VariableInfo* newVar = createVariableInfo(name, type, line, initialized);
-    if (*head == NULL) {
-        *head = newVar;
-        return;
+    // Keep the load factor at or below one half
+    if ((table->count + 1) * 2 > table->capacity) {
+        growVariableTable(table);
     }
-    VariableInfo* current = *head;
-    while (current->next != NULL) {
-        current = current->next;
+    insertVariableSlot(table->slots, table->capacity, newVar);
+    newVar->order = table->count++;
+
+    if (table->tail == NULL) {
+        table->head = newVar;
+    } else {
+        table->tail->next = newVar;
     }
-    current->next = newVar;
+    table->tail = newVar;
+    return newVar;
 }
 
-VariableInfo* findVariable(VariableInfo* head, char* name) {
-    VariableInfo* current = head;
-    
-    while (current != NULL) {
-        if (strcmp(current->name, name) == 0) {
-            return current;
+VariableInfo* findVariable(VariableTable* table, char* name) {
+    unsigned int hash = hashName(name);
+    unsigned int mask = table->capacity - 1;
+    unsigned int i = hash & mask;
+
+    while (table->slots[i] != NULL) {
+        VariableInfo* var = table->slots[i];
+        if (var->hash == hash && strcmp(var->name, name) == 0) {
+            return var;
         }
-        current = current->next;
+        i = (i + 1) & mask;
     }
     
     return NULL;
 }
 
+// Same as findVariable, for a name that is len characters of a longer string.
+VariableInfo* findVariableLength(VariableTable* table, const char* name, int len) {
+    unsigned int hash = hashNameLength(name, len);
+    unsigned int mask = table->capacity - 1;
+    unsigned int i = hash & mask;
+
+    while (table->slots[i] != NULL) {
+        VariableInfo* var = table->slots[i];
+        if (var->hash == hash && strncmp(var->name, name, len) == 0 && var->name[len] == '\0') {
+            return var;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
 // Marks a variable as freed and detects double free attempts.
-void markVariableAsFreed(VariableInfo* head, char* name, int current_line_number) {
-    VariableInfo* var = findVariable(head, name);
+void markVariableAsFreed(VariableTable* table, char* name, int current_line_number, FindingWriter* writer) {
+    VariableInfo* var = findVariable(table, name);
+    char message[200];
     if (var != NULL) {
         // Only apply free logic if we are confident it's a pointer that was dynamically allocated.
         // The "pointer" type is set when malloc/calloc is detected.
         if (strcmp(var->type, "pointer") == 0) {
             if (var->is_freed) {
-                printf("Error: Double free detected for variable '%s' at line %d (previously freed at line %d).\n",
+                snprintf(message, sizeof(message), "Double free detected for variable '%s' at line %d (previously freed at line %d).",
                        var->name, current_line_number, var->freed_line);
+                writeFinding(writer, SEVERITY_ERROR, "Double Free", current_line_number, message);
             } else {
                 var->is_freed = 1;
                 var->freed_line = current_line_number; // Record line where it was freed
+                table->freed_count++;
             }
         }
     } else {
-         printf("Warning: Attempt to free untracked variable '%s' at line %d.\n", name, current_line_number);
-    }
-}
-
-void checkForUseAfterFree(VariableInfo* head, const char* line_content, int current_line_number) {
-    VariableInfo* current_var = head;
-    while (current_var != NULL) {
-        // Check only if the variable is a pointer and has been freed
-        if (current_var->is_freed && strcmp(current_var->type, "pointer") == 0) {
-            char pattern_dereference[55];
-            sprintf(pattern_dereference, "*%s", current_var->name);
-            
-            const char* occurrence_deref = strstr(line_content, pattern_dereference);
-            if (occurrence_deref) {
-                char char_after_match = *(occurrence_deref + strlen(pattern_dereference));
-                if (!isalnum((unsigned char)char_after_match) && char_after_match != '_') {
-                    char free_call_on_deref[60];
-                    sprintf(free_call_on_deref, "free(%s)", pattern_dereference); // e.g., free(*ptr)
-                     if (strstr(line_content, free_call_on_deref) == NULL) {
-                         printf("Error: Potential use-after-free. Variable '%s' (freed at line %d) seems to be dereferenced at line %d.\n",
-                               current_var->name, current_var->freed_line, current_line_number);
-                     }
-                }
-            }
-            // Heuristic 2: Check for "varname->" (member access)
-            char pattern_arrow[55];
-            sprintf(pattern_arrow, "%s->", current_var->name);
-            if (strstr(line_content, pattern_arrow) != NULL) {
-                 // Avoid reporting UAF if this line is where it was just freed (if free is like "free(ptr->member)") - less common
-                 printf("Error: Potential use-after-free. Variable '%s' (freed at line %d) seems to be used with '->' operator at line %d.\n",
-                       current_var->name, current_var->freed_line, current_line_number);
-            }
-            char* temp_line = strdup(line_content); // Work on a copy for strtok
-            if (temp_line) {
-                char* token = strtok(temp_line, " \t\n\r(){}[];,=.+-/%*&|!<>");
-                while (token != NULL) {
-                    if (strcmp(token, current_var->name) == 0) {
-                        char free_call_pattern[60];
-                        sprintf(free_call_pattern, "free(%s)", current_var->name);
-                        if (strstr(line_content, free_call_pattern) == NULL && current_line_number > current_var->declaration_line) {
-                             printf("Error: Potential use-after-free. Variable '%s' (freed at line %d) seems to be used as a token at line %d.\n",
-                                   current_var->name, current_var->freed_line, current_line_number);
-                            break; // Found use, no need to check other tokens for this var on this line
-                        }
-                    }
-                    token = strtok(NULL, " \t\n\r(){}[];,=.+-/%*&|!<>");
-                }
-                free(temp_line);
-            }
-        }
-        current_var = current_var->next;
+         snprintf(message, sizeof(message), "Attempt to free untracked variable '%s' at line %d.", name, current_line_number);
+         writeFinding(writer, SEVERITY_WARNING, "Untracked Free", current_line_number, message);
     }
 }
-char* extractVariableFromDeclaration(char* line) {
-    static char var_name[50];
-    char* current_pos = line;
 
-    while (*current_pos && isspace((unsigned char)*current_pos)) {
-        current_pos++;
-    }
-    if (*current_pos == '\0') return NULL;
+// The variables a per-line check picked out of one line, to be checked in
+// declaration order. Lives on the stack; a line naming more variables than fit
+// only has them marked (seen_line), and the caller walks the table instead.
+#define MAX_LINE_CANDIDATES 64
 
-    char* type_keyword_end = current_pos;
-    while (*type_keyword_end && !isspace((unsigned char)*type_keyword_end)) {
-        type_keyword_end++;
-    }
-    char* name_start_ptr = type_keyword_end;
-    while (*name_start_ptr && isspace((unsigned char)*name_start_ptr)) {
-        name_start_ptr++;
-    }
-    if (*name_start_ptr == '\0' || *name_start_ptr == ';') return NULL; // No variable name found (e.g., "int ;")
+typedef struct LineCandidates {
+    VariableInfo* items[MAX_LINE_CANDIDATES];
+    int count;
+    int line;
+} LineCandidates;
 
-    char* name_end_ptr = name_start_ptr;
-    // Variable name ends at ';', '=', ',', '[', '(', or newline
-    name_end_ptr = strpbrk(name_start_ptr, ";=,[(\n");
-    if (name_end_ptr == NULL) {
-        return NULL;
-    }
-
-    int name_len = name_end_ptr - name_start_ptr;
-    if (name_len >= 50 || name_len <= 0) return NULL;
+void beginLineCandidates(LineCandidates* candidates, int line_number) {
+    candidates->count = 0;
+    candidates->line = line_number;
+}
 
-    strncpy(var_name, name_start_ptr, name_len);
-    var_name[name_len] = '\0';
+void addLineCandidate(LineCandidates* candidates, VariableInfo* var) {
+    if (var->seen_line == candidates->line)
+        return;
+    var->seen_line = candidates->line;
+    if (candidates->count < MAX_LINE_CANDIDATES)
+        candidates->items[candidates->count] = var;
+    candidates->count++;
+}
 
-    // Trim trailing spaces from the extracted variable name
-    int i = name_len - 1;
-    while (i >= 0 && isspace((unsigned char)var_name[i])) {
-        var_name[i] = '\0';
-        i--;
+// Returns 0 if there were too many to keep; check seen_line along the table then.
+int sortLineCandidates(LineCandidates* candidates) {
+    if (candidates->count > MAX_LINE_CANDIDATES)
+        return 0;
+    for (int i = 1; i < candidates->count; i++) {
+        VariableInfo* var = candidates->items[i];
+        int j = i;
+        while (j > 0 && candidates->items[j - 1]->order > var->order) {
+            candidates->items[j] = candidates->items[j - 1];
+            j--;
+        }
+        candidates->items[j] = var;
     }
-    if (strlen(var_name) == 0) return NULL;
-
-    return var_name;
+    return 1;
 }
 
-char* extractVariableFromAllocation(char* line) {
-    static char var_name[50];
-    char* equals_pos = NULL;
-    char* name_end = NULL;
-
-    equals_pos = strchr(line, '=');
-    if (equals_pos == NULL) return NULL;
-
-    // Go backwards from equals to find variable name
-    char* name_start = equals_pos - 1;
-    while (name_start > line && *name_start == ' ') name_start--;
-
-    // Find start of variable name (after type or space)
-    char* name_end_rev = name_start;
-    while (name_end_rev > line && 
-           (isalnum(*name_end_rev) || *name_end_rev == '_')) name_end_rev--;
-
-    int name_len = name_start - name_end_rev;
-    if (name_len >= 50 || name_len <= 0) return NULL;
-    
-    strncpy(var_name, name_end_rev + 1, name_len);
-    var_name[name_len] = '\0';
-    
-    return var_name;
+// Whether the '*' at index i of the line dereferences what follows rather than
+// multiplying: it starts the line or follows an operator or "return".
+int isUnaryStar(const LexLine* line, int i) {
+    if (i == 0)
+        return 1;
+    const LexToken* previous = &line->tokens[i - 1];
+    if (previous->kind == LEX_PUNCT)
+        return !isPunct(line->text, previous, ')') && !isPunct(line->text, previous, ']');
+    return previous->kind == LEX_IDENTIFIER && tokenEquals(line->text, previous, "return");
 }
 
-char* extractVariableFromFree(char* line) {
-    static char var_name[50];
-    char* open_paren = NULL;
-    char* close_paren = NULL;
-
-    open_paren = strstr(line, "free(");
-    if (open_paren == NULL) return NULL;
-    open_paren += 5;
-
-    close_paren = strchr(open_paren, ')');
-    if (close_paren == NULL) return NULL;
+// Whether tokens i - 2 .. i + 1 (or i - 3 .. i + 1 with a '*') are "free(name)".
+int isFreeArgument(const LexLine* line, int i, int dereferenced) {
+    int open = i - 1 - dereferenced;
+    return open >= 1 && i + 1 < line->count &&
+           isPunct(line->text, &line->tokens[open], '(') &&
+           tokenEquals(line->text, &line->tokens[open - 1], "free") &&
+           isPunct(line->text, &line->tokens[i + 1], ')');
+}
 
-    int name_len = close_paren - open_paren;
-    if (name_len >= 50 || name_len <= 0) return NULL;
+int tokenNamesVariable(const LexLine* line, int i, const VariableInfo* var) {
+    const LexToken* token = &line->tokens[i];
+    return token->kind == LEX_IDENTIFIER && token->length == (int)strlen(var->name) &&
+           memcmp(line->text + token->offset, var->name, token->length) == 0;
+}
 
-    strncpy(var_name, open_paren, name_len);
-    var_name[name_len] = '\0';
-    
-    // Trim spaces
-    int i = 0;
-    while (var_name[i] == ' ') i++;
-    
-    if (i > 0) {
-        memmove(var_name, var_name + i, name_len - i + 1);
+// Reports the uses of one freed pointer on a line: "*name", "name->", or name on its own.
+void reportUseAfterFree(VariableInfo* current_var, const LexLine* line, FindingWriter* writer) {
+    int current_line_number = line->number;
+    int dereferenced = 0, dereference_freed = 0, arrow = 0, freed_here = 0;
+    for (int i = 0; i < line->count; i++) {
+        if (!tokenNamesVariable(line, i, current_var))
+            continue;
+        if (i >= 1 && isPunct(line->text, &line->tokens[i - 1], '*') && isUnaryStar(line, i - 1)) {
+            dereferenced = 1;
+            if (isFreeArgument(line, i, 1))
+                dereference_freed = 1; // e.g., free(*ptr)
+        }
+        if (i + 1 < line->count && tokenEquals(line->text, &line->tokens[i + 1], "->"))
+            arrow = 1;
+        if (isFreeArgument(line, i, 0))
+            freed_here = 1;
     }
 
-    i = strlen(var_name) - 1;
-    while (i >= 0 && var_name[i] == ' ') {
-        var_name[i] = '\0';
-        i--;
+    char message[200];
+    if (dereferenced && !dereference_freed) {
+        snprintf(message, sizeof(message), "Potential use-after-free. Variable '%s' (freed at line %d) seems to be dereferenced at line %d.",
+               current_var->name, current_var->freed_line, current_line_number);
+        writeFinding(writer, SEVERITY_ERROR, "Use After Free", current_line_number, message);
+    }
+    // Heuristic 2: Check for "varname->" (member access)
+    if (arrow) {
+         snprintf(message, sizeof(message), "Potential use-after-free. Variable '%s' (freed at line %d) seems to be used with '->' operator at line %d.",
+               current_var->name, current_var->freed_line, current_line_number);
+         writeFinding(writer, SEVERITY_ERROR, "Use After Free", current_line_number, message);
+    }
+    if (!freed_here && current_line_number > current_var->declaration_line) {
+         snprintf(message, sizeof(message), "Potential use-after-free. Variable '%s' (freed at line %d) seems to be used as a token at line %d.",
+               current_var->name, current_var->freed_line, current_line_number);
+         writeFinding(writer, SEVERITY_ERROR, "Use After Free", current_line_number, message);
     }
-    
-    return var_name;
 }
 
-int isVariableDeclaration(char* line) {
-    // Check for common C types
-    return (strstr(line, "int ") != NULL || 
-            strstr(line, "char ") != NULL || 
-            strstr(line, "float ") != NULL || 
-            strstr(line, "double ") != NULL || 
-            strstr(line, "long ") != NULL || 
-            strstr(line, "short ") != NULL || 
-            strstr(line, "struct ") != NULL);
-}
+// Each identifier of the line is looked up once; the freed pointers among them
+// get the full checks, in declaration order. Nothing is allocated.
+void checkForUseAfterFree(VariableTable* table, const LexLine* line, FindingWriter* writer) {
+    if (table->freed_count == 0)
+        return;
+    LineCandidates candidates;
+    beginLineCandidates(&candidates, line->number);
+    for (int i = 0; i < line->count; i++) {
+        const LexToken* token = &line->tokens[i];
+        if (token->kind != LEX_IDENTIFIER || token->length >= 50)
+            continue;
+        VariableInfo* var = findVariableLength(table, line->text + token->offset, token->length);
+        if (var != NULL && var->is_freed && strcmp(var->type, "pointer") == 0)
+            addLineCandidate(&candidates, var);
+    }
 
-int isInitialized(char* line) {
-    return (strchr(line, '=') != NULL);
+    if (!sortLineCandidates(&candidates)) {
+        for (VariableInfo* var = table->head; var != NULL; var = var->next) {
+            if (var->seen_line == line->number)
+                reportUseAfterFree(var, line, writer);
+        }
+        return;
+    }
+    for (int i = 0; i < candidates.count; i++)
+        reportUseAfterFree(candidates.items[i], line, writer);
 }
 
-char* extractVariableType(char* line) {
-    static char var_type[20];
-    char* type_start = line;
+// Storage classes and qualifiers that may come before a declaration's type
+const char* declarationPrefixes[] = {"static", "const", "extern", "volatile", "register", "auto"};
+// Type keywords that start a variable declaration
+const char* declarationTypes[] = {
+    "int", "char", "float", "double", "long", "short", "struct", "union", "enum", "unsigned", "signed", "void"
+};
+
+int tokenInList(const char* text, const LexToken* token, const char** words, int count) {
+    if (token->kind != LEX_IDENTIFIER)
+        return 0;
+    for (int i = 0; i < count; i++) {
+        if (tokenEquals(text, token, words[i]))
+            return 1;
+    }
+    return 0;
+}
 
-    while (*type_start && isspace((unsigned char)*type_start)) {
-        type_start++;
+#define IS_DECLARATION_PREFIX(text, token) tokenInList(text, token, declarationPrefixes, (int)(sizeof(declarationPrefixes) / sizeof(declarationPrefixes[0])))
+#define IS_DECLARATION_TYPE(text, token) tokenInList(text, token, declarationTypes, (int)(sizeof(declarationTypes) / sizeof(declarationTypes[0])))
+// A typedef name from the line's headers
+#define IS_DECLARED_TYPE(line, token) scopeDeclares((line)->declarations, (line)->text, token, DECLARES_TYPE)
+
+// Recognises a line declaring a variable: optional qualifiers, a type keyword
+// (or a type the line's headers name with typedef), stars, then the name, followed by ';', ',', '=', '[' or the end of the line
+// ("for (int i = 0; ..." counts too). The first declarator is the one taken.
+// var_type is the type keyword, or "pointer" for a pointer. Returns 0 if the
+// line isn't a declaration, e.g. a function prototype or definition.
+int parseDeclaration(const LexLine* line, char* var_name, char* var_type, int* initialized) {
+    const char* text = line->text;
+    const LexToken* tokens = line->tokens;
+    int count = line->count;
+    int i = 0;
+    if (count >= 2 && tokenEquals(text, &tokens[0], "for") && isPunct(text, &tokens[1], '('))
+        i = 2;
+    while (i < count && IS_DECLARATION_PREFIX(text, &tokens[i]))
+        i++;
+    if (i >= count || !(IS_DECLARATION_TYPE(text, &tokens[i]) || IS_DECLARED_TYPE(line, &tokens[i])))
+        return 0;
+    const LexToken* type = &tokens[i++];
+    if (tokenEquals(text, type, "struct") || tokenEquals(text, type, "union") || tokenEquals(text, type, "enum")) {
+        if (i < count && tokens[i].kind == LEX_IDENTIFIER)
+            i++; // The tag
     }
-    if (*type_start == '\0') {
-        return NULL;
+    // "unsigned long int", "long const", ...
+    while (i < count && (IS_DECLARATION_TYPE(text, &tokens[i]) || IS_DECLARATION_PREFIX(text, &tokens[i])))
+        i++;
+    int pointer = 0;
+    while (i < count && (isPunct(text, &tokens[i], '*') || tokenEquals(text, &tokens[i], "const"))) {
+        pointer |= isPunct(text, &tokens[i], '*');
+        i++;
     }
-
-    char* type_end_ptr = type_start;
-    // Find end of the type keyword (the next space or end of string)
-    while (*type_end_ptr && !isspace((unsigned char)*type_end_ptr) && *type_end_ptr != '*') { // also stop if '*' is encountered for pointers like char*
-        type_end_ptr++;
+    if (i >= count || tokens[i].kind != LEX_IDENTIFIER)
+        return 0;
+    const LexToken* name = &tokens[i++];
+    if (i < count && !isPunct(text, &tokens[i], ';') && !isPunct(text, &tokens[i], ',') &&
+        !isPunct(text, &tokens[i], '=') && !isPunct(text, &tokens[i], '['))
+        return 0;
+    if (copyTokenText(text, name, var_name, 50) == NULL)
+        return 0;
+    if (pointer) {
+        strcpy(var_type, "pointer");
+    } else if (copyTokenText(text, type, var_type, 20) == NULL) {
+        return 0;
     }
-
-    int type_len = type_end_ptr - type_start;
-    if (type_len <= 0 || type_len >= 20) {
-        return NULL;
+    *initialized = 0;
+    for (; i < count; i++) {
+        if (isPunct(text, &tokens[i], '='))
+            *initialized = 1;
     }
+    return 1;
+}
 
-    strncpy(var_type, type_start, type_len);
-    var_type[type_len] = '\0';
-    return var_type;
+// The variable assigned the result of malloc or calloc on this line, e.g. "p = malloc(n)",
+// or of an allocator the line's headers declare.
+char* extractVariableFromAllocation(const LexLine* line, char* var_name) {
+    int allocates = 0;
+    int equals = -1;
+    for (int i = 0; i < line->count; i++) {
+        const LexToken* token = &line->tokens[i];
+        if (equals == -1 && isPunct(line->text, token, '='))
+            equals = i;
+        if (tokenEquals(line->text, token, "malloc") || tokenEquals(line->text, token, "calloc") ||
+            scopeDeclares(line->declarations, line->text, token, DECLARES_ALLOCATOR))
+            allocates = 1;
+    }
+    if (!allocates || equals < 1 || line->tokens[equals - 1].kind != LEX_IDENTIFIER)
+        return NULL;
+    return copyTokenText(line->text, &line->tokens[equals - 1], var_name, 50);
 }
 
-char* extractFunction(char* line) {
-    static char function_name[50];
-    char* open_paren = strchr(line, '(');
-    if (!open_paren) return NULL;
-    char* name_start = open_paren - 1;
-    while (name_start > line && *name_start == ' ') name_start--;
-    char* name_end = name_start;
-    while (name_end > line && (isalnum(*name_end) || *name_end == '_')) name_end--;
-    if (!isalnum(*name_end) && *name_end != '_') name_end++;
-    int name_len = name_start - name_end + 1;
-    if (name_len <= 0 || name_len >= 50) return NULL;
-    strncpy(function_name, name_end, name_len);
-    function_name[name_len] = '\0';
-    return function_name;
+// The argument of the free call whose name is token i of the line, as written
+// ("ptr", "node->next"), or NULL if it can't be taken.
+char* extractVariableFromFree(const LexLine* line, int i, char* var_name) {
+    if (i + 1 >= line->count || !isPunct(line->text, &line->tokens[i + 1], '('))
+        return NULL;
+    int depth = 0;
+    int close = i + 1;
+    for (; close < line->count; close++) {
+        if (isPunct(line->text, &line->tokens[close], '('))
+            depth++;
+        else if (isPunct(line->text, &line->tokens[close], ')') && --depth == 0)
+            break;
+    }
+    if (close >= line->count || close == i + 2)
+        return NULL;
+    const LexToken* first = &line->tokens[i + 2];
+    const LexToken* last = &line->tokens[close - 1];
+    int name_len = last->offset + last->length - first->offset;
+    if (name_len >= 50 || name_len <= 0)
+        return NULL;
+    memcpy(var_name, line->text + first->offset, name_len);
+    var_name[name_len] = '\0';
+    return var_name;
 }
 
 FunctionInfo* createFunctionInfo(char* name, int start_line) {
@@ -300,6 +425,7 @@ FunctionInfo* createFunctionInfo(char* name, int start_line) {
     strcpy(newFunc->name, name);
     newFunc->start_line = start_line;
     newFunc->end_line = -1;
+    newFunc->scan_token = -1;
     newFunc->next = NULL;
     return newFunc;
 }
@@ -317,144 +443,88 @@ void addFunction(FunctionInfo** head, char* name, int start_line) {
     current->next = newFunc;
 }
 
-FunctionInfo* extractAllFunctions(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        printf("Error opening file: %s\n", filename);
-        return NULL;
-    }
-    
-    char line[256];
-    int line_number = 1;
-    FunctionInfo* functions = NULL;
-    FunctionInfo* current_function = NULL;
-    int brace_count = 0;
-    int in_function = 0;
-    
-    while (fgets(line, sizeof(line), file)) {
-        // More lenient function detection
-        // Look for patterns that might indicate a function declaration
-        if (!in_function && 
-            strchr(line, '(') != NULL && 
-            !strstr(line, "=") && 
-            !strstr(line, "if") && 
-            !strstr(line, "for") && 
-            !strstr(line, "while") && 
-            !strstr(line, "#include") && 
-            !strstr(line, "#define")) {
-            
-            char* func_name = extractFunction(line);
-            if (func_name != NULL && strlen(func_name) > 0) {
-                addFunction(&functions, func_name, line_number);
-                current_function = functions;
-                while (current_function->next != NULL) {
-                    current_function = current_function->next;
-                }
-                in_function = 1;
-                brace_count = 0; // Reset brace count for new function
-
-                if (strchr(line, '{') != NULL) {
-                    brace_count++;
-                }
-            }
+// Finds the next function definition at or after token *next: a name at brace
+// depth 0 followed by a parenthesised parameter list and a body. Prototypes,
+// macro calls and braces of struct definitions or initializers are passed over.
+// On success, gives the tokens of the name and of the body's braces (body_end
+// is the token count for a body that is never closed) and moves *next past it.
+int nextFunctionDefinition(const LexedSource* lexed, int* next, int* name, int* body, int* body_end) {
+    const char* text = lexed->source.data;
+    int i = *next;
+    while (i < lexed->count) {
+        const LexToken* token = &lexed->tokens[i];
+        if (isPunct(text, token, '{')) {
+            i = findClosingToken(lexed, i) + 1;
+            continue;
         }
-        // Count braces to track function body
-        if (in_function) {
-            // Count opening braces
-            char* ptr = line;
-            while ((ptr = strchr(ptr, '{')) != NULL) {
-                brace_count++;
-                ptr++;
-            }
-
-            ptr = line;
-            while ((ptr = strchr(ptr, '}')) != NULL) {
-                brace_count--;
-                ptr++;
-                
-                // If brace count reaches 0, we've found the end of the function
-                if (brace_count == 0) {
-                    current_function->end_line = line_number;
-                    in_function = 0;
-                }
-            }
-
-            // Safety check: if we reach a new function signature while still in a function,
-            // force end the current function and start a new one
-            if (strchr(line, '(') != NULL && 
-                !strstr(line, "=") && 
-                !strstr(line, "if") && 
-                !strstr(line, "for") && 
-                !strstr(line, "while") && 
-                (strstr(line, "int ") || strstr(line, "void ") || 
-                 strstr(line, "char ") || strstr(line, "float ") || 
-                 strstr(line, "double ") || strstr(line, "long ") || 
-                 strstr(line, "struct "))) {
-
-                if (current_function != NULL) {
-                    current_function->end_line = line_number - 1; // End before the new function starts
-                }
-
-                char* func_name = extractFunction(line);
-                if (func_name != NULL && strlen(func_name) > 0) {
-                    brace_count = 0;
-
-                    if (strchr(line, '{') != NULL) {
-                        brace_count++;
-                    }
-                }
-            }
-            // Check for common syntax errors
-            if (current_function != NULL) {
-                // Basic check for missing semicolons (can be expanded)
-                if (strstr(line, "for") == NULL && // Ignore for loop conditions
-                    strstr(line, "if") == NULL && // Ignore if conditions
-                    strstr(line, "while") == NULL && // Ignore while conditions
-                    strstr(line, "{") == NULL && // Ignore opening braces
-                    strstr(line, "}") == NULL && // Ignore closing braces
-                    strstr(line, "//") == NULL && // Ignore comments
-                    strchr(line, ';') == NULL && strlen(line) > 2) { // Not an empty line
-                    
-                    // Check if line should have a semicolon
-                    if (isalnum(line[0]) || strchr(line, '=') != NULL || 
-                        strstr(line, "printf") != NULL || strstr(line, "return") != NULL) {
-                        // Potential missing semicolon (further analysis needed for accuracy)
-                    }
-                }
-                // Extra semicolons
-                if (strstr(line, ");") != NULL && strstr(line, ");;") != NULL) {
-                    // Potential extra semicolon
-                }
-                if (strstr(line, "if") != NULL && strchr(line, '(') != NULL && 
-                    strchr(line, ')') != NULL && strchr(line, ';') != NULL && 
-                    strchr(line, '{') == NULL) {
-                    // Semicolon after if condition likely an error
-                }
-            }
+        if (token->kind != LEX_IDENTIFIER || i + 1 >= lexed->count || !isPunct(text, &lexed->tokens[i + 1], '(')) {
+            i++;
+            continue;
+        }
+        int close = findClosingToken(lexed, i + 1);
+        if (close + 1 < lexed->count && isPunct(text, &lexed->tokens[close + 1], '{')) {
+            *name = i;
+            *body = close + 1;
+            *body_end = findClosingToken(lexed, close + 1);
+            *next = *body_end + 1;
+            return 1;
         }
-        line_number++;
+        i = close + 1;
     }
-    
-    // Handle case where the last function doesn't have a closing brace
-    if (in_function && current_function != NULL) {
-        current_function->end_line = line_number - 1;
+    *next = lexed->count;
+    return 0;
+}
+
+// Each function runs from the line of its name to the line of its closing brace.
+FunctionInfo* extractFunctionsFromTokens(const LexedSource* lexed) {
+    StatsMark mark = statsEnter(STAGE_FUNCTIONS);
+    FunctionInfo* functions = NULL;
+    FunctionInfo* last = NULL;
+    int next = 0, name, body, body_end;
+    int scan_token = 0;
+    while (nextFunctionDefinition(lexed, &next, &name, &body, &body_end)) {
+        char name_buffer[50];
+        int found_from = scan_token;
+        scan_token = next;
+        if (copyTokenText(lexed->source.data, &lexed->tokens[name], name_buffer, sizeof(name_buffer)) == NULL)
+            continue;
+        FunctionInfo* added = createFunctionInfo(name_buffer, lexed->tokens[name].line);
+        added->scan_token = found_from;
+        added->end_line = body_end < lexed->count ? lexed->tokens[body_end].line
+                                                  : lexed->first_line + lexed->line_count - 1;
+        if (last != NULL) {
+            last->next = added;
+        } else {
+            functions = added;
+        }
+        last = added;
     }
+    statsLeave(mark, lexed->line_count);
+    return functions;
+}
 
-    fclose(file);
+FunctionInfo* extractAllFunctions(const char* filename, FILE* out) {
+    LexedSource lexed;
+    if (!openLexedFile(filename, &lexed)) {
+        fprintf(out, "Error opening file: %s\n", filename);
+        return NULL;
+    }
+    FunctionInfo* functions = extractFunctionsFromTokens(&lexed);
+    closeLexedSource(&lexed);
     return functions;
 }
 
-void displayFunctions(FunctionInfo* head) {
+void displayFunctions(FunctionInfo* head, FILE* out) {
     if (head == NULL) {
-        printf("No functions found!\n");
+        fprintf(out, "No functions found!\n");
         return;
     }
     FunctionInfo* current = head;
     int count = 1;
-    printf("\n===== FUNCTIONS DETECTED =====\n\n");
+    fprintf(out, "\n===== FUNCTIONS DETECTED =====\n\n");
     while (current != NULL) {
-        printf("Function #%d: %s", count, current->name);
-        printf("\tFrom line: %d\n\n", current->start_line);
+        fprintf(out, "Function #%d: %s", count, current->name);
+        fprintf(out, "\tFrom line: %d\n\n", current->start_line);
         current = current->next;
         count++;
     }
@@ -471,22 +541,73 @@ void freeFunctionList(FunctionInfo* head) {
     }
 }
 
+// Walks the scopes of a file line by line: each function in the list is a scope
+// from its first line to its last, and lines outside every function belong to
+// the file scope. Functions that start inside the one being walked are not
+// scopes of their own.
+typedef struct FunctionScopes {
+    FunctionInfo* next;      // Next function not reached yet
+    int end_line;            // Last line of the current function, 0 at file scope
+} FunctionScopes;
+
+// The lines a pass looks at. A file split into chunks has its functions' lines
+// analysed chunk by chunk, and its file-scope lines, which share one scope
+// across the whole file, in a pass of their own.
+typedef enum ScopeFilter {
+    SCOPES_ALL,
+    SCOPES_FUNCTIONS,
+    SCOPES_FILE
+} ScopeFilter;
+
+int scopeSelected(const FunctionScopes* scopes, ScopeFilter filter) {
+    return filter == SCOPES_ALL || (filter == SCOPES_FUNCTIONS) == (scopes->end_line != 0);
+}
 
-void displayVariables(VariableInfo* head) {
-    if (head == NULL) {
-        printf("No variables found.\n");
+void beginFunctionScopes(FunctionScopes* scopes, FunctionInfo* functions) {
+    scopes->next = functions;
+    scopes->end_line = 0;
+}
+
+// Moves to the scope of line_number. Returns 1 if that is a different scope from
+// the previous line's: a function starts or ends here.
+int enterFunctionScope(FunctionScopes* scopes, int line_number) {
+    int changed = 0;
+    if (scopes->end_line != 0 && line_number > scopes->end_line) {
+        scopes->end_line = 0;
+        changed = 1;
+    }
+    if (scopes->end_line == 0) {
+        while (scopes->next != NULL && scopes->next->start_line < line_number) {
+            scopes->next = scopes->next->next;
+        }
+        if (scopes->next != NULL && scopes->next->start_line == line_number) {
+            FunctionInfo* function = scopes->next;
+            scopes->end_line = function->end_line < line_number ? line_number : function->end_line;
+            scopes->next = function->next;
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+void displayVariables(VariableTable* table, FILE* out) {
+    if (table == NULL || table->head == NULL) {
+        fprintf(out, "No variables found.\n");
         return;
     }
-    VariableInfo* current = head;
-    printf("Variables Detected:\n\n");
+    VariableInfo* current = table->head;
+    fprintf(out, "Variables Detected:\n\n");
     while (current != NULL) {
-            printf("Name: %s\nType: %s\nLine: %d\tInitialised: %s\tfreed: %s\n\n", current->name, current->type, current->declaration_line, current->is_initialized? "Yes" : "No", current->is_freed? "Yes" : "No");
+            fprintf(out, "Name: %s\nType: %s\nLine: %d\tInitialised: %s\tfreed: %s\n\n", current->name, current->type, current->declaration_line, current->is_initialized? "Yes" : "No", current->is_freed? "Yes" : "No");
         current = current->next;
     }
 }
 
-void freeVariableList(VariableInfo* head) {
-    VariableInfo* current = head;
+void freeVariableTable(VariableTable* table) {
+    if (table == NULL) {
+        return;
+    }
+    VariableInfo* current = table->head;
     VariableInfo* next;
 
     while (current != NULL) {
@@ -494,71 +615,171 @@ void freeVariableList(VariableInfo* head) {
         free(current);
         current = next;
     }
+    free(table->slots);
+    free(table);
 }
 
-VariableInfo* extractAllVariables(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        printf("Error opening file: %s\n", filename);
-        return NULL;
+// Makes the variables chained from head, in declaration order, the contents of table.
+void rebuildVariableTable(VariableTable* table, VariableInfo* head) {
+    table->head = head;
+    table->tail = NULL;
+    table->count = 0;
+    table->freed_count = 0;
+    for (VariableInfo* var = head; var != NULL; var = var->next) {
+        var->order = table->count++;
+        table->freed_count += var->is_freed;
+        table->tail = var;
     }
+    free(table->slots);
+    table->capacity = 16;
+    while (table->capacity < table->count * 2) {
+        table->capacity *= 2;
+    }
+    table->slots = (VariableInfo**)calloc(table->capacity, sizeof(VariableInfo*));
+    if (table->slots == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (VariableInfo* var = head; var != NULL; var = var->next) {
+        insertVariableSlot(table->slots, table->capacity, var);
+    }
+}
+
+// Merges two lists that are each in declaration order.
+VariableInfo* mergeVariablesByLine(VariableInfo* a, VariableInfo* b) {
+    VariableInfo* head = NULL;
+    VariableInfo** tail = &head;
+    while (a != NULL && b != NULL) {
+        VariableInfo** first = a->declaration_line <= b->declaration_line ? &a : &b;
+        *tail = *first;
+        tail = &(*first)->next;
+        *first = (*first)->next;
+    }
+    *tail = a != NULL ? a : b;
+    return head;
+}
+
+// Ends a function's scope. Its variables are freed, or with keep_symbols moved
+// to the end of the kept list.
+void closeVariableScope(VariableTable* scope, int keep_symbols, VariableInfo** kept_head, VariableInfo** kept_tail) {
+    if (keep_symbols && scope->head != NULL) {
+        if (*kept_tail == NULL) {
+            *kept_head = scope->head;
+        } else {
+            (*kept_tail)->next = scope->head;
+        }
+        *kept_tail = scope->tail;
+        scope->head = NULL;
+    }
+    freeVariableTable(scope);
+}
+
+// Each function in functions gets its own symbol table, created on its first line
+// and dropped after its last, so a name in one function is never mistaken for the
+// same name in another and only the current function's symbols are kept in memory.
+// Code outside functions shares one file-scope table. With keep_symbols, the
+// variables of every scope are returned, in declaration order, for the report;
+// otherwise nothing is kept and NULL is returned.
+// Only the lines from .. to - 1 (counting from 0) of the scopes filter selects are
+// looked at; a range must start at a function's first line or at file scope.
+VariableTable* extractVariablesInLines(const LexedSource* lexed, int from, int to, FunctionInfo* functions,
+                                       ScopeFilter filter, int keep_symbols, FindingWriter* writer) {
+    StatsMark mark = statsEnter(STAGE_VARIABLES);
+    FunctionScopes scopes;
+    beginFunctionScopes(&scopes, functions);
+    VariableTable* file_scope = createVariableTable();
+    VariableTable* variables = file_scope;
+    VariableInfo* kept_head = NULL; // Variables of functions already left, with keep_symbols
+    VariableInfo* kept_tail = NULL;
+    int scanned = 0;
     
-    char line[256];
-    int line_number = 1;
-    VariableInfo* variables = NULL;
-    
-    while (fgets(line, sizeof(line), file)) {
-        char current_line_copy[256];
-        strncpy(current_line_copy, line, sizeof(current_line_copy) - 1);
-        current_line_copy[sizeof(current_line_copy) - 1] = '\0';
+    for (int index = from; index < to; index++) {
+        LexLine line;
+        getLexLine(lexed, index, &line);
+        int line_number = line.number;
+
+        if (enterFunctionScope(&scopes, line_number)) {
+            if (variables != file_scope) {
+                closeVariableScope(variables, keep_symbols, &kept_head, &kept_tail);
+            }
+            variables = scopes.end_line != 0 ? createVariableTable() : file_scope;
+        }
+        if (!scopeSelected(&scopes, filter)) {
+            continue;
+        }
+        scanned++;
+        if (line.count == 0 || line.tokens[0].kind == LEX_DIRECTIVE) {
+            continue;
+        }
 
         // 1. Check for Use-After-Free for variables freed on *previous* lines
-        checkForUseAfterFree(variables, current_line_copy, line_number);
+        checkForUseAfterFree(variables, &line, writer);
 
         // 2. Check for variable declarations
-        if (isVariableDeclaration(current_line_copy)) {
-            char* var_name = extractVariableFromDeclaration(current_line_copy);
-            char* var_type = extractVariableType(current_line_copy);
-            int initialized = isInitialized(current_line_copy);
-            
-            if (var_name != NULL && var_type != NULL) {
-                // Only add if not already found (e.g. from a malloc earlier)
-                // and ensure it's not a re-declaration error (advanced check, not done here)
-                if (findVariable(variables, var_name) == NULL) {
-                     addVariable(&variables, var_name, var_type, line_number, initialized);
-                }
+        char name_buffer[50], type_buffer[20];
+        int initialized;
+        if (parseDeclaration(&line, name_buffer, type_buffer, &initialized)) {
+            // Only add if not already found (e.g. from a malloc earlier)
+            // and ensure it's not a re-declaration error (advanced check, not done here)
+            if (findVariable(variables, name_buffer) == NULL) {
+                 addVariable(variables, name_buffer, type_buffer, line_number, initialized);
             }
         }
 
         // 3. Check for memory allocations (malloc, calloc)
-        if (strstr(current_line_copy, "malloc") || strstr(current_line_copy, "calloc")) {
-            char* var_name = extractVariableFromAllocation(current_line_copy);
-            if (var_name != NULL) {
-                VariableInfo* var = findVariable(variables, var_name);
-                if (var == NULL) {
-                    addVariable(&variables, var_name, "pointer", line_number, 1); // Allocated, so initialized
-                } else {
-                    // Variable already declared, now it's being (re)assigned a malloc'd pointer
-                    strcpy(var->type, "pointer"); // Ensure type is "pointer"
-                    var->is_initialized = 1;
-                    var->is_freed = 0; // If it was freed and is being reassigned, it's no longer freed
-                    var->freed_line = 0;
-                }
+        char* var_name = extractVariableFromAllocation(&line, name_buffer);
+        if (var_name != NULL) {
+            VariableInfo* var = findVariable(variables, var_name);
+            if (var == NULL) {
+                addVariable(variables, var_name, "pointer", line_number, 1); // Allocated, so initialized
+            } else {
+                // Variable already declared, now it's being (re)assigned a malloc'd pointer
+                strcpy(var->type, "pointer"); // Ensure type is "pointer"
+                var->is_initialized = 1;
+                if (var->is_freed)
+                    variables->freed_count--;
+                var->is_freed = 0; // If it was freed and is being reassigned, it's no longer freed
+                var->freed_line = 0;
             }
         }
         
         // 4. Check for memory deallocations (free) and detect double free
-        if (strstr(current_line_copy, "free(")) { // More specific than just "free"
-            char* var_name = extractVariableFromFree(current_line_copy);
-            if (var_name != NULL) {
-                markVariableAsFreed(variables, var_name, line_number);
-            } else {
+        for (int i = 0; i < line.count; i++) {
+            if (tokenEquals(line.text, &line.tokens[i], "free")) {
+                var_name = extractVariableFromFree(&line, i, name_buffer);
+                if (var_name != NULL) {
+                    markVariableAsFreed(variables, var_name, line_number, writer);
+                }
             }
         }
-        
-        line_number++;
     }
-    
-    fclose(file);
+    if (variables != file_scope) {
+        closeVariableScope(variables, keep_symbols, &kept_head, &kept_tail);
+    }
+    if (!keep_symbols) {
+        freeVariableTable(file_scope);
+        file_scope = NULL;
+    } else {
+        rebuildVariableTable(file_scope, mergeVariablesByLine(file_scope->head, kept_head));
+    }
+    statsLeave(mark, scanned);
+    return file_scope;
+}
+
+VariableTable* extractVariablesFromTokens(const LexedSource* lexed, FunctionInfo* functions, int keep_symbols, FindingWriter* writer) {
+    return extractVariablesInLines(lexed, 0, lexed->line_count, functions, SCOPES_ALL, keep_symbols, writer);
+}
+
+// Scopes come from the functions found in the file's own tokens.
+VariableTable* extractAllVariables(const char* filename, int keep_symbols, FindingWriter* writer) {
+    LexedSource lexed;
+    if (!openLexedFile(filename, &lexed)) {
+        writeMessage(writer, "Error opening file: %s\n", filename);
+        return NULL;
+    }
+    FunctionInfo* functions = extractFunctionsFromTokens(&lexed);
+    VariableTable* variables = extractVariablesFromTokens(&lexed, functions, keep_symbols, writer);
+    freeFunctionList(functions);
+    closeLexedSource(&lexed);
     return variables;
-}
\ No newline at end of file
+}
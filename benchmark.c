@@ -0,0 +1,585 @@
+// Benchmark for the analysis passes.
+// Build:  gcc -O2 -pthread benchmark.c -o benchmark
+// Usage:  benchmark [functions] [iterations]
+//         benchmark --symbols [variables]
+//         benchmark --incremental [functions]
+//         benchmark --suite [--max-lines N] [--timeout SECONDS] [generator options]
+//         benchmark --generate FILE [--lines N] [generator options]
+// Generator options: --functions N --variables N --calls N --allocations N
+//                    --bugs PERCENT --seed N
+//
+// Generates a synthetic C file (bench_input.txt) with the requested number of
+// functions, then times a bare read of the file against a full analyse_code run.
+// With --symbols, compares the hashed VariableTable against a plain linked list.
+// With --incremental, times re-analysis after editing one function against a
+// from-scratch analysis, and checks that both give the same findings.
+// With --suite, generates sources of 1k, 10k, 100k and 1M lines and reports the
+// time, lines/s and peak RSS of every analysis stage on each; --generate only
+// writes such a source.
+#define BUGFIXER_NO_MAIN
+#include "test.c"
+#include <time.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <limits.h>
+
+#define BENCH_INPUT "bench_input.txt"
+
+double now_seconds() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Writes a balanced C file made of small functions that trigger most detectors.
+// Function number edited gets one extra line, to simulate an edit (-1 for none).
+int generate_input(const char* filename, int functions, int edited) {
+    FILE* out = fopen(filename, "w");
+    if (out == NULL) {
+        printf("Error creating %s\n", filename);
+        return 0;
+    }
+    int lines = 0;
+    fprintf(out, "#include <stdio.h>\n#include <stdlib.h>\n\n");
+    lines += 3;
+    for (int i = 0; i < functions; i++) {
+        fprintf(out, "int func_%d(int n) {\n", i);
+        fprintf(out, "    int total = 0;\n");
+        fprintf(out, "    int count;\n");
+        if (i == edited) {
+            fprintf(out, "    int edited = n / 0;\n");
+            lines++;
+        }
+        fprintf(out, "    int *buffer = (int*)malloc(n * sizeof(int));\n");
+        fprintf(out, "    for(int j = 0; j < n; j++) {\n");
+        fprintf(out, "        buffer[j] = j * %d;\n", i);
+        fprintf(out, "        total += buffer[j];\n");
+        fprintf(out, "    }\n");
+        fprintf(out, "    printf(\"%%d\\n\", count)\n");
+        fprintf(out, "    free(buffer);\n");
+        fprintf(out, "    return total + func_%d(n - 1);\n", i > 0 ? i - 1 : 0);
+        fprintf(out, "}\n\n");
+        lines += 13;
+    }
+    fclose(out);
+    return lines;
+}
+
+// One pass over the file's line views, which is the I/O cost of each pass analyse_code makes.
+double time_read_pass(const char* filename) {
+    double start = now_seconds();
+    SourceFile source;
+    LineView view;
+    if (openSourceFile(filename, &source)) {
+        while (nextLine(&source, &view)) {
+        }
+        closeSourceFile(&source);
+    }
+    return now_seconds() - start;
+}
+
+// The linked-list symbol store VariableTable replaced, kept here as the baseline.
+void listAddVariable(VariableInfo** head, char* name, char* type, int line, int initialized) {
+    VariableInfo* newVar = createVariableInfo(name, type, line, initialized);
+    if (*head == NULL) {
+        *head = newVar;
+        return;
+    }
+    VariableInfo* current = *head;
+    while (current->next != NULL) {
+        current = current->next;
+    }
+    current->next = newVar;
+}
+
+VariableInfo* listFindVariable(VariableInfo* head, char* name) {
+    for (VariableInfo* current = head; current != NULL; current = current->next) {
+        if (strcmp(current->name, name) == 0) {
+            return current;
+        }
+    }
+    return NULL;
+}
+
+// Same access pattern as extractAllVariables: look up every declaration before adding
+// it, then look every name up again as later lines use it.
+int bench_symbols(int variables) {
+    char name[50];
+    int found = 0;
+
+    double start = now_seconds();
+    VariableInfo* list = NULL;
+    for (int i = 0; i < variables; i++) {
+        sprintf(name, "var_%d", i);
+        if (listFindVariable(list, name) == NULL) {
+            listAddVariable(&list, name, "int", i, 0);
+        }
+    }
+    for (int i = 0; i < variables; i++) {
+        sprintf(name, "var_%d", i);
+        found += listFindVariable(list, name) != NULL;
+    }
+    double list_time = now_seconds() - start;
+    while (list != NULL) {
+        VariableInfo* next = list->next;
+        free(list);
+        list = next;
+    }
+
+    start = now_seconds();
+    VariableTable* table = createVariableTable();
+    for (int i = 0; i < variables; i++) {
+        sprintf(name, "var_%d", i);
+        if (findVariable(table, name) == NULL) {
+            addVariable(table, name, "int", i, 0);
+        }
+    }
+    for (int i = 0; i < variables; i++) {
+        sprintf(name, "var_%d", i);
+        found += findVariable(table, name) != NULL;
+    }
+    double table_time = now_seconds() - start;
+    freeVariableTable(table);
+
+    printf("Symbols: %d variables, %d inserts and %d lookups each\n\n", variables, variables, variables * 2);
+    printf("linked list:   %10.2f ms\n", list_time * 1000);
+    printf("hash table:    %10.2f ms\n", table_time * 1000);
+    printf("speedup:       %10.1fx\n", list_time / table_time);
+    return found == variables * 2 ? 0 : 1;
+}
+
+// JSON Lines of everything the incremental state currently reports.
+char* incremental_report(IncrementalFile* state, size_t* size) {
+    char* text = NULL;
+    FILE* out = open_memstream(&text, size);
+    FindingWriter* writer = (FindingWriter*)malloc(sizeof(FindingWriter));
+    if (out == NULL || writer == NULL) {
+        printf("Memory allocation failed.\n");
+        exit(1);
+    }
+    initFindingWriter(writer, out, OUTPUT_JSONL, BENCH_INPUT);
+    write_incremental(state, writer);
+    fclose(out);
+    free(writer);
+    return text;
+}
+
+int bench_incremental(int functions) {
+    int lines = generate_input(BENCH_INPUT, functions, -1);
+    if (lines == 0) {
+        return 1;
+    }
+    printf("Incremental: %s, %d lines, one function edited\n\n", BENCH_INPUT, lines);
+
+    IncrementalFile state = {NULL, 0, NULL, 0, 0};
+    double start = now_seconds();
+    update_incremental(&state, BENCH_INPUT);
+    double cold_time = now_seconds() - start;
+    int segments = state.analysed;
+
+    generate_input(BENCH_INPUT, functions, functions / 2);
+    start = now_seconds();
+    update_incremental(&state, BENCH_INPUT);
+    double update_time = now_seconds() - start;
+    int analysed = state.analysed;
+
+    IncrementalFile fresh = {NULL, 0, NULL, 0, 0};
+    start = now_seconds();
+    update_incremental(&fresh, BENCH_INPUT);
+    double fresh_time = now_seconds() - start;
+
+    FILE* sink = tmpfile();
+    FindingWriter* writer = (FindingWriter*)malloc(sizeof(FindingWriter));
+    if (sink == NULL || writer == NULL) {
+        printf("Memory allocation failed.\n");
+        return 1;
+    }
+    initFindingWriter(writer, sink, OUTPUT_JSONL, BENCH_INPUT);
+    start = now_seconds();
+    analyse_file(BENCH_INPUT, writer, 1);
+    double full_time = now_seconds() - start;
+    fclose(sink);
+    free(writer);
+
+    size_t updated_size, fresh_size;
+    char* updated = incremental_report(&state, &updated_size);
+    char* expected = incremental_report(&fresh, &fresh_size);
+    int same = updated_size == fresh_size && memcmp(updated, expected, fresh_size) == 0;
+
+    printf("analyse_file:         %10.2f ms\n", full_time * 1000);
+    printf("cold, %6d segments: %10.2f ms\n", segments, cold_time * 1000);
+    printf("from scratch:         %10.2f ms\n", fresh_time * 1000);
+    printf("update, %4d analysed: %10.2f ms\n", analysed, update_time * 1000);
+    printf("update matches a from-scratch run: %s\n", same ? "yes" : "NO");
+
+    free(updated);
+    free(expected);
+    free_incremental(&state);
+    free_incremental(&fresh);
+    remove(BENCH_INPUT);
+    return same ? 0 : 1;
+}
+
+// Shape of a synthetic source for --generate and --suite.
+typedef struct GeneratorOptions {
+    int lines;               // Total to aim for; function bodies are padded to reach it
+    int functions;           // 0: one function per 40 lines
+    int variables;           // Declared in each function, every other one uninitialized
+    int calls;               // Calls from each function to other generated functions
+    int allocations;         // malloc/free pairs in each function
+    int bug_percent;         // Allocations then freed twice or used after free
+    unsigned int seed;
+} GeneratorOptions;
+
+unsigned int next_random(unsigned int* state) {
+    unsigned int x = *state; // xorshift32: the same seed always gives the same file
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// Writes a synthetic C source as options describe. Returns the number of lines.
+int generate_source(const char* filename, const GeneratorOptions* options) {
+    FILE* out = fopen(filename, "w");
+    if (out == NULL) {
+        printf("Error creating %s\n", filename);
+        return 0;
+    }
+    unsigned int random = options->seed ? options->seed : 1;
+    int functions = options->functions > 0 ? options->functions : options->lines / 40;
+    if (functions < 1)
+        functions = 1;
+    int variables = options->variables > 0 ? options->variables : 1; // Function results go in v0
+    int fixed = 4 + variables + options->calls + 3 * options->allocations;
+    int body = (options->lines - 3) / functions;
+    int filler = body > fixed ? body - fixed : 0;
+
+    int lines = 0;
+    fprintf(out, "#include <stdio.h>\n#include <stdlib.h>\n\n");
+    lines += 3;
+    for (int f = 0; f < functions; f++) {
+        fprintf(out, "int gen_%d(int n) {\n", f);
+        lines++;
+        for (int v = 0; v < variables; v++) {
+            if (v % 2 == 0)
+                fprintf(out, "    int f%d_v%d = n + %d;\n", f, v, v);
+            else
+                fprintf(out, "    int f%d_v%d;\n", f, v);
+            lines++;
+        }
+        for (int a = 0; a < options->allocations; a++) {
+            fprintf(out, "    char *f%d_p%d = (char*)malloc(n + %d);\n", f, a, a + 1);
+            fprintf(out, "    f%d_p%d[0] = 'a';\n", f, a);
+            lines += 2;
+        }
+        for (int c = 0; c < options->calls; c++) {
+            fprintf(out, "    f%d_v0 = gen_%u(f%d_v0);\n", f, next_random(&random) % functions, f);
+            lines++;
+        }
+        for (int i = 0; i < filler; i++) {
+            int v = i % variables;
+            fprintf(out, "    f%d_v%d = f%d_v%d * %d + n;\n", f, v, f, v, i + 1);
+            lines++;
+        }
+        for (int a = 0; a < options->allocations; a++) {
+            fprintf(out, "    free(f%d_p%d);\n", f, a);
+            lines++;
+            if ((int)(next_random(&random) % 100) < options->bug_percent) {
+                if (next_random(&random) % 2)
+                    fprintf(out, "    free(f%d_p%d);\n", f, a);
+                else
+                    fprintf(out, "    f%d_p%d[0] = 'b';\n", f, a);
+                lines++;
+            }
+        }
+        fprintf(out, "    return f%d_v0;\n}\n\n", f);
+        lines += 3;
+    }
+    fclose(out);
+    return lines;
+}
+
+// ---- Stage suite ----
+// Each stage runs in a child process of its own, so its peak RSS is its own and a
+// stage that blows up (quadratic, or worse) can be stopped by a time limit.
+
+FILE* stage_sink; // Findings are formatted, as in real use, then thrown away
+
+void stage_read(const char* filename) {
+    SourceFile source;
+    LineView view;
+    if (openSourceFile(filename, &source)) {
+        while (nextLine(&source, &view)) {
+        }
+        closeSourceFile(&source);
+    }
+}
+
+void stage_lexer(const char* filename) {
+    LexedSource lexed;
+    if (openLexedFile(filename, &lexed)) {
+        closeLexedSource(&lexed);
+    }
+}
+
+void stage_analyse_code(const char* filename) {
+    TokenList tokenList = {NULL, NULL, NULL, NULL};
+    analyse_code(filename, &tokenList, stage_sink);
+    ShowTokens(tokenList.head, stage_sink);
+    delete_tokens(&tokenList);
+}
+
+FindingWriter* stage_writer(const char* filename) {
+    FindingWriter* writer = (FindingWriter*)malloc(sizeof(FindingWriter));
+    if (writer == NULL) {
+        printf("Memory allocation failed.\n");
+        exit(1);
+    }
+    initFindingWriter(writer, stage_sink, OUTPUT_JSONL, filename);
+    return writer;
+}
+
+void stage_variables(const char* filename) {
+    FindingWriter* writer = stage_writer(filename);
+    freeVariableTable(extractAllVariables(filename, 0, writer));
+    flushFindingWriter(writer);
+    free(writer);
+}
+
+void stage_functions(const char* filename) {
+    freeFunctionList(extractAllFunctions(filename, stage_sink));
+}
+
+void stage_recursion(const char* filename) {
+    FindingWriter* writer = stage_writer(filename);
+    detectInfiniteRecursion(filename, writer);
+    flushFindingWriter(writer);
+    free(writer);
+}
+
+void stage_analyse_file(const char* filename) {
+    FindingWriter* writer = stage_writer(filename);
+    analyse_file(filename, writer, 1);
+    free(writer);
+}
+
+// The same, with every detector on a thread of its own
+void stage_analyse_file_parallel(const char* filename) {
+    FindingWriter* writer = stage_writer(filename);
+    split_min_lines = INT_MAX;
+    analyse_file(filename, writer, DETECTOR_COUNT);
+    free(writer);
+}
+
+// The same, with the file split into chunks at its functions
+void stage_analyse_file_split(const char* filename) {
+    FindingWriter* writer = stage_writer(filename);
+    split_min_lines = 0;
+    analyse_file(filename, writer, 4);
+    free(writer);
+}
+
+void stage_incremental(const char* filename) {
+    IncrementalFile state = {NULL, 0, NULL, 0, 0};
+    update_incremental(&state, filename);
+    free_incremental(&state);
+}
+
+typedef struct Stage {
+    const char* name;
+    void (*run)(const char* filename);
+} Stage;
+
+Stage stages[] = {
+    {"read", stage_read},
+    {"lexer", stage_lexer},
+    {"analyse_code", stage_analyse_code},
+    {"variables", stage_variables},
+    {"functions", stage_functions},
+    {"recursion", stage_recursion},
+    {"file", stage_analyse_file},
+    {"file_parallel", stage_analyse_file_parallel},
+    {"file_split", stage_analyse_file_split},
+    {"incremental", stage_incremental},
+};
+
+// Runs one stage in a child. Returns 0 if it failed or ran out of time.
+int run_stage(const Stage* stage, const char* filename, int timeout, double* seconds, long* peak_kb) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        printf("Could not create pipe.\n");
+        exit(1);
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        printf("Could not start stage process.\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        alarm(timeout);
+        stage_sink = fopen("/dev/null", "w");
+        double start = now_seconds();
+        stage->run(filename);
+        double elapsed = now_seconds() - start;
+        ssize_t written = write(fds[1], &elapsed, sizeof(elapsed));
+        _exit(written == sizeof(elapsed) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t got = read(fds[0], seconds, sizeof(*seconds));
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    *peak_kb = usage.ru_maxrss;
+    return got == sizeof(*seconds) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int bench_suite(GeneratorOptions options, int max_lines, int timeout) {
+    int explicit_functions = options.functions;
+    printf("Stage suite: %d variables, %d calls, %d allocations per function, %d%% buggy frees, %ds limit per stage\n\n",
+           options.variables, options.calls, options.allocations, options.bug_percent, timeout);
+    printf("%9s  %-13s %12s %14s %12s\n", "lines", "stage", "time ms", "lines/s", "peak RSS MB");
+    for (int size = 1000; size <= max_lines; size *= 10) {
+        options.lines = size;
+        options.functions = explicit_functions;
+        int lines = generate_source(BENCH_INPUT, &options);
+        if (lines == 0) {
+            return 1;
+        }
+        for (int s = 0; s < (int)(sizeof(stages) / sizeof(stages[0])); s++) {
+            double seconds = 0;
+            long peak_kb = 0;
+            if (run_stage(&stages[s], BENCH_INPUT, timeout, &seconds, &peak_kb)) {
+                printf("%9d  %-13s %12.2f %14.0f %12.1f\n", lines, stages[s].name, seconds * 1000,
+                       lines / (seconds > 0 ? seconds : 1e-9), peak_kb / 1024.0);
+            } else {
+                printf("%9d  %-13s %12s %14s %12.1f\n", lines, stages[s].name, "timeout", "-", peak_kb / 1024.0);
+            }
+        }
+        remove(BENCH_INPUT);
+    }
+    return 0;
+}
+
+// Reads generator options from argv[first] onwards; also --max-lines and --timeout.
+int parse_generator_options(int argc, char* argv[], int first, GeneratorOptions* options, int* max_lines, int* timeout) {
+    for (int i = first; i < argc; i++) {
+        if (i + 1 >= argc) {
+            printf("Missing value for %s\n", argv[i]);
+            return 0;
+        }
+        int value = atoi(argv[i + 1]);
+        if (value < 0) {
+            printf("Invalid value for %s: %s\n", argv[i], argv[i + 1]);
+            return 0;
+        }
+        if (strcmp(argv[i], "--lines") == 0) options->lines = value;
+        else if (strcmp(argv[i], "--functions") == 0) options->functions = value;
+        else if (strcmp(argv[i], "--variables") == 0) options->variables = value;
+        else if (strcmp(argv[i], "--calls") == 0) options->calls = value;
+        else if (strcmp(argv[i], "--allocations") == 0) options->allocations = value;
+        else if (strcmp(argv[i], "--bugs") == 0) options->bug_percent = value;
+        else if (strcmp(argv[i], "--seed") == 0) options->seed = value;
+        else if (strcmp(argv[i], "--max-lines") == 0) *max_lines = value;
+        else if (strcmp(argv[i], "--timeout") == 0) *timeout = value > 0 ? value : 1;
+        else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 0;
+        }
+        i++;
+    }
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--symbols") == 0) {
+        int variables = argc > 2 ? atoi(argv[2]) : 20000;
+        if (variables <= 0) {
+            printf("Usage: %s --symbols [variables]\n", argv[0]);
+            return 1;
+        }
+        return bench_symbols(variables);
+    }
+    if (argc > 1 && strcmp(argv[1], "--incremental") == 0) {
+        int functions = argc > 2 ? atoi(argv[2]) : 5000;
+        if (functions <= 0) {
+            printf("Usage: %s --incremental [functions]\n", argv[0]);
+            return 1;
+        }
+        return bench_incremental(functions);
+    }
+    if (argc > 1 && (strcmp(argv[1], "--suite") == 0 || strcmp(argv[1], "--generate") == 0)) {
+        GeneratorOptions options = {10000, 0, 8, 2, 2, 10, 1};
+        int max_lines = 1000000;
+        int timeout = 60;
+        int generate = strcmp(argv[1], "--generate") == 0;
+        if ((generate && argc < 3) || !parse_generator_options(argc, argv, generate ? 3 : 2, &options, &max_lines, &timeout)) {
+            printf("Usage: %s --suite [--max-lines N] [--timeout SECONDS] [generator options]\n", argv[0]);
+            printf("       %s --generate FILE [--lines N] [generator options]\n", argv[0]);
+            return 1;
+        }
+        if (generate) {
+            int lines = generate_source(argv[2], &options);
+            printf("Wrote %s, %d lines\n", argv[2], lines);
+            return lines == 0;
+        }
+        return bench_suite(options, max_lines, timeout);
+    }
+
+    int functions = argc > 1 ? atoi(argv[1]) : 5000;
+    int iterations = argc > 2 ? atoi(argv[2]) : 3;
+    if (functions <= 0 || iterations <= 0) {
+        printf("Usage: %s [functions] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    int lines = generate_input(BENCH_INPUT, functions, -1);
+    if (lines == 0) {
+        return 1;
+    }
+    FILE* file = fopen(BENCH_INPUT, "r");
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+
+    printf("Input: %s, %d lines, %.2f MB, %d iterations\n\n", BENCH_INPUT, lines, size / 1e6, iterations);
+
+    double read_total = 0;
+    for (int i = 0; i < iterations; i++) {
+        read_total += time_read_pass(BENCH_INPUT);
+    }
+
+    double wall_total = 0;
+    double cpu_total = 0;
+    int findings = 0;
+    for (int i = 0; i < iterations; i++) {
+        TokenList tokenList = {NULL, NULL, NULL, NULL};
+        clock_t cpu_start = clock();
+        double wall_start = now_seconds();
+        analyse_code(BENCH_INPUT, &tokenList, stdout);
+        wall_total += now_seconds() - wall_start;
+        cpu_total += (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+
+        findings = 0;
+        for (token* t = tokenList.head; t != NULL; t = t->next) {
+            findings++;
+        }
+        delete_tokens(&tokenList);
+    }
+
+    double read_ms = read_total / iterations * 1000;
+    double wall_ms = wall_total / iterations * 1000;
+    double cpu_ms = cpu_total / iterations * 1000;
+    printf("read pass:     %10.2f ms/run\n", read_ms);
+    printf("analyse_code:  %10.2f ms/run wall, %10.2f ms/run cpu\n", wall_ms, cpu_ms);
+    printf("throughput:    %10.0f lines/s, %.2f MB/s\n", lines / (wall_ms / 1000), size / 1e6 / (wall_ms / 1000));
+    printf("findings:      %10d\n", findings);
+
+    remove(BENCH_INPUT);
+    return 0;
+}
@@ -3,160 +3,694 @@
 #include <string.h>
 #include <ctype.h>
 
-#define MAX_FUNCS 100
-#define MAX_NAME_LEN 100
-
-// Structure for adjacency list node
-typedef struct Node {
-    int index;
-    int call_line_number; // Line number where this call occurs
-    struct Node* next;
-} Node;
-
-// Graph structure
-Node* adjList[MAX_FUNCS];
-int visited[MAX_FUNCS];
-int recStack[MAX_FUNCS];
-char functionNames[MAX_FUNCS][MAX_NAME_LEN];
-int funcCount = 0;
-
-// Create a new node
-Node* createNode(int index, int line_num) {
-    Node* newNode = (Node*)malloc(sizeof(Node));
-    newNode->index = index;
-    newNode->call_line_number = line_num;
-    newNode->next = NULL;
-    return newNode;
-}
-
-// Add edge from function u to function v
-void addEdge(int u, int v, int line_num) {
-    Node* newNode = createNode(v, line_num);
-    newNode->next = adjList[u];
-    adjList[u] = newNode;
-}
-// Get or assign function index
-int getFunctionIndex(char* name) {
-    for (int i = 0; i < funcCount; i++) {
-        if (strcmp(functionNames[i], name) == 0)
-            return i;
-    }
-    strcpy(functionNames[funcCount], name);
-    funcCount++;
-    return funcCount - 1;
-}
-
-// DFS to detect cycles
-int isCyclic(int v) {
-    visited[v] = 1;
-    recStack[v] = 1;
-
-    Node* temp = adjList[v];
-    while (temp != NULL) {
-        int neighbor = temp->index;
-        if (!visited[neighbor]) {
-            if (isCyclic(neighbor))
-                return 1; // Cycle detected deeper, message already printed
-        } else if (recStack[neighbor]) {
-            // Cycle detected: function 'v' calls 'neighbor' on 'temp->call_line_number'
-            // and 'neighbor' is already in the recursion stack.
-            printf("⚠️ Infinite recursion detected: Function '%s' calling function '%s' on line %d forms a cycle.\n",
-                   functionNames[v], functionNames[neighbor], temp->call_line_number);
-            return 1;
-        }
-        temp = temp->next;
+// A call seen while reading, resolved once every definition in the file is known
+typedef struct CallSite {
+    int caller;
+    int calleeOffset;        // Callee name in the graph's calleePool
+    int call_line_number;
+    int file;                // Index into the graph's files; 0 in a graph of one file
+} CallSite;
+
+// Call graph for one file. Everything lives in this context object so several
+// graphs can exist at once (one per file or thread); all arrays grow as needed.
+// Function names are interned in one character pool and looked up through an
+// open-addressing hash index. Calls are gathered as pending call sites while the
+// file is read, then resolved and packed into CSR (compressed sparse row) arrays:
+// the calls made by function i are edgeTarget/edgeLine[edgeStart[i] .. edgeStart[i + 1]).
+// A graph put together from several files (a project) also names the file each
+// call is in, and its reports say which file a line is in.
+typedef struct CallGraph {
+    char* namePool;          // Interned function names, each NUL-terminated
+    int namePoolSize;
+    int namePoolCapacity;
+    int* nameOffset;         // Offset of each function's name in namePool
+    int funcCount;
+    int funcCapacity;
+
+    int* slots;              // Open-addressing index into nameOffset, -1 when empty
+    int slotCount;           // Always a power of two
+
+    CallSite* calls;
+    int callCount;
+    int callCapacity;
+    char* calleePool;
+    int calleePoolSize;
+    int calleePoolCapacity;
+    char** files;            // Files of the calls, for a graph of several files; none otherwise
+    int fileCount;
+    int fileCapacity;
+
+    // CSR edges, filled by buildCallGraph
+    int* edgeStart;
+    int* edgeTarget;
+    int* edgeLine;
+    int* edgeFile;
+    int edgeCount;
+} CallGraph;
+
+void* growArray(void* array, int* capacity, int needed, size_t elementSize) {
+    if (needed <= *capacity)
+        return array;
+    int newCapacity = *capacity ? *capacity : 64;
+    while (newCapacity < needed)
+        newCapacity *= 2;
+    array = realloc(array, elementSize * newCapacity);
+    if (array == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
     }
+    *capacity = newCapacity;
+    return array;
+}
 
-    recStack[v] = 0;
-    return 0;
+CallGraph* createCallGraph() {
+    CallGraph* graph = (CallGraph*)calloc(1, sizeof(CallGraph));
+    if (graph == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    graph->slotCount = 256;
+    graph->slots = (int*)malloc(sizeof(int) * graph->slotCount);
+    if (graph->slots == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (int i = 0; i < graph->slotCount; i++)
+        graph->slots[i] = -1;
+    return graph;
 }
 
-// Driver function to detect infinite recursion
-void detectInfiniteRecursion(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        printf("Error opening file.\n");
+void freeCallGraph(CallGraph* graph) {
+    if (graph == NULL)
         return;
+    free(graph->namePool);
+    free(graph->nameOffset);
+    free(graph->slots);
+    free(graph->calls);
+    free(graph->calleePool);
+    for (int i = 0; i < graph->fileCount; i++)
+        free(graph->files[i]);
+    free(graph->files);
+    free(graph->edgeStart);
+    free(graph->edgeTarget);
+    free(graph->edgeLine);
+    free(graph->edgeFile);
+    free(graph);
+}
+
+const char* functionName(const CallGraph* graph, int index) {
+    return graph->namePool + graph->nameOffset[index];
+}
+
+// Returns the slot holding the name, or the empty slot where it would go
+int findFunctionSlot(const CallGraph* graph, const char* name, int len) {
+    unsigned int mask = graph->slotCount - 1;
+    unsigned int i = hashNameLength(name, len) & mask;
+    while (graph->slots[i] != -1) {
+        const char* existing = functionName(graph, graph->slots[i]);
+        if (strncmp(existing, name, len) == 0 && existing[len] == '\0')
+            break;
+        i = (i + 1) & mask;
     }
+    return i;
+}
+
+// Look up a function index, -1 if the function is not defined in the file
+int lookupFunctionIndex(const CallGraph* graph, const char* name, int len) {
+    return graph->slots[findFunctionSlot(graph, name, len)];
+}
+
+void growFunctionSlots(CallGraph* graph) {
+    free(graph->slots);
+    graph->slotCount *= 2;
+    graph->slots = (int*)malloc(sizeof(int) * graph->slotCount);
+    if (graph->slots == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (int i = 0; i < graph->slotCount; i++)
+        graph->slots[i] = -1;
+    for (int f = 0; f < graph->funcCount; f++) {
+        const char* name = functionName(graph, f);
+        graph->slots[findFunctionSlot(graph, name, strlen(name))] = f;
+    }
+}
+
+// Get or assign the index of the function named by len characters at name
+int getFunctionIndexLength(CallGraph* graph, const char* name, int len) {
+    int slot = findFunctionSlot(graph, name, len);
+    if (graph->slots[slot] != -1)
+        return graph->slots[slot];
+
+    // Keep the index at most half full
+    if ((graph->funcCount + 1) * 2 > graph->slotCount) {
+        growFunctionSlots(graph);
+        slot = findFunctionSlot(graph, name, len);
+    }
+    graph->nameOffset = (int*)growArray(graph->nameOffset, &graph->funcCapacity, graph->funcCount + 1, sizeof(int));
+    graph->namePool = (char*)growArray(graph->namePool, &graph->namePoolCapacity, graph->namePoolSize + len + 1, 1);
+    memcpy(graph->namePool + graph->namePoolSize, name, len);
+    graph->namePool[graph->namePoolSize + len] = '\0';
+    graph->nameOffset[graph->funcCount] = graph->namePoolSize;
+    graph->namePoolSize += len + 1;
+    graph->slots[slot] = graph->funcCount;
+    return graph->funcCount++;
+}
+
+int getFunctionIndex(CallGraph* graph, const char* name) {
+    return getFunctionIndexLength(graph, name, strlen(name));
+}
+
+// Adds a file calls can be in; returns its index.
+int addCallGraphFile(CallGraph* graph, const char* name) {
+    graph->files = (char**)growArray(graph->files, &graph->fileCapacity, graph->fileCount + 1, sizeof(char*));
+    graph->files[graph->fileCount] = strdup(name);
+    if (graph->files[graph->fileCount] == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    return graph->fileCount++;
+}
+
+void addCallSiteInFile(CallGraph* graph, int caller, const char* callee, int len, int line_num, int file) {
+    graph->calls = (CallSite*)growArray(graph->calls, &graph->callCapacity, graph->callCount + 1, sizeof(CallSite));
+    graph->calleePool = (char*)growArray(graph->calleePool, &graph->calleePoolCapacity, graph->calleePoolSize + len + 1, 1);
 
-    // Initialize structures
-    for (int i = 0; i < MAX_FUNCS; i++) {
-        adjList[i] = NULL;
-        visited[i] = 0;
-        recStack[i] = 0;
-    }
-
-    char line[256];
-    char currentFunction[MAX_NAME_LEN] = "";
-    int file_line_num = 0;
-
-    while (fgets(line, sizeof(line), file)) {
-        // Skip comment lines
-        if (strstr(line, "//") == line) {
-        file_line_num++;
-        continue;}
-
-        // Detect function definitions
-        char name[MAX_NAME_LEN];
-        file_line_num++;
-        if (sscanf(line, "void %[^()](", name) == 1 ||
-            sscanf(line, "int %[^()](", name) == 1 ||
-            sscanf(line, "float %[^()](", name) == 1 ||
-            sscanf(line, "double %[^()](", name) == 1 ||
-            sscanf(line, "char %[^()](", name) == 1) {
-            strcpy(currentFunction, name);
-            getFunctionIndex(name);  // Register function
+    memcpy(graph->calleePool + graph->calleePoolSize, callee, len);
+    graph->calleePool[graph->calleePoolSize + len] = '\0';
+    graph->calls[graph->callCount].caller = caller;
+    graph->calls[graph->callCount].calleeOffset = graph->calleePoolSize;
+    graph->calls[graph->callCount].call_line_number = line_num;
+    graph->calls[graph->callCount].file = file;
+    graph->calleePoolSize += len + 1;
+    graph->callCount++;
+}
+
+void addCallSite(CallGraph* graph, int caller, const char* callee, int len, int line_num) {
+    addCallSiteInFile(graph, caller, callee, len, line_num, 0);
+}
+
+// Resolves pending calls against the functions defined in the file and packs the
+// edges into CSR form with a counting sort on the caller (stable, so each
+// function's calls stay in file order). Calls to functions not defined here
+// (library calls, keywords like sizeof) are dropped.
+void buildCallGraph(CallGraph* graph) {
+    StatsMark mark = statsEnter(STAGE_RECURSION);
+    int* target = (int*)malloc(sizeof(int) * (graph->callCount + 1));
+    graph->edgeStart = (int*)calloc(graph->funcCount + 1, sizeof(int));
+    if (target == NULL || graph->edgeStart == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    graph->edgeCount = 0;
+    for (int i = 0; i < graph->callCount; i++) {
+        const char* callee = graph->calleePool + graph->calls[i].calleeOffset;
+        target[i] = lookupFunctionIndex(graph, callee, strlen(callee));
+        if (target[i] != -1) {
+            graph->edgeStart[graph->calls[i].caller + 1]++;
+            graph->edgeCount++;
         }
+    }
+    for (int f = 0; f < graph->funcCount; f++)
+        graph->edgeStart[f + 1] += graph->edgeStart[f];
 
-        // Detect function calls (stricter check)
-        for (int i = 0; i < funcCount; i++) {
-            char pattern[MAX_NAME_LEN + 3];
-            sprintf(pattern, "%s(", functionNames[i]);
+    graph->edgeTarget = (int*)malloc(sizeof(int) * (graph->edgeCount + 1));
+    graph->edgeLine = (int*)malloc(sizeof(int) * (graph->edgeCount + 1));
+    graph->edgeFile = (int*)malloc(sizeof(int) * (graph->edgeCount + 1));
+    int* fill = (int*)malloc(sizeof(int) * (graph->funcCount + 1));
+    if (graph->edgeTarget == NULL || graph->edgeLine == NULL || graph->edgeFile == NULL || fill == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    memcpy(fill, graph->edgeStart, sizeof(int) * (graph->funcCount + 1));
+    for (int i = 0; i < graph->callCount; i++) {
+        if (target[i] == -1)
+            continue;
+        int e = fill[graph->calls[i].caller]++;
+        graph->edgeTarget[e] = target[i];
+        graph->edgeLine[e] = graph->calls[i].call_line_number;
+        graph->edgeFile[e] = graph->calls[i].file;
+    }
+    free(fill);
+    free(target);
+    statsLeave(mark, 0);
+}
 
-            if (strstr(line, pattern)) {
-                if (strlen(currentFunction) > 0) { // Ensure we are inside a function context
-                    int u = getFunctionIndex(currentFunction);
-                    int v = getFunctionIndex(functionNames[i]);
-                    addEdge(u, v, file_line_num); // Add edge with line number
-                }
+// Slot of the call on this line (an index from lineStart on) to the callee
+// named by len characters at name, or the free slot where it would go. Older
+// calls in the set count as free, so it never needs clearing between lines.
+int findLineCallSlot(const CallGraph* graph, const int* set, int mask, int lineStart, const char* name, int len) {
+    int i = (int)(hashNameLength(name, len) & (unsigned int)mask);
+    while (set[i] >= lineStart) {
+        const char* callee = graph->calleePool + graph->calls[set[i]].calleeOffset;
+        if (strncmp(callee, name, len) == 0 && callee[len] == '\0')
+            break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+// Records every identifier followed by '(' in tokens from .. to - 1 as a call
+// from caller. Literals and comments never reach here: they aren't identifiers.
+void collectCalls(CallGraph* graph, const LexedSource* lexed, int from, int to, int caller) {
+    const char* text = lexed->source.data;
+    int lineStart = graph->callCount;
+    int line = -1;
+    // The calls recorded on the current line, by callee name
+    int capacity = 64;
+    int* set = (int*)malloc(sizeof(int) * capacity);
+    if (set == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (int i = 0; i < capacity; i++)
+        set[i] = -1;
+    for (int t = from; t < to; t++) {
+        const LexToken* token = &lexed->tokens[t];
+        if (token->kind != LEX_IDENTIFIER || t + 1 >= to || !isPunct(text, &lexed->tokens[t + 1], '('))
+            continue;
+        if (token->line != line) {
+            line = token->line;
+            lineStart = graph->callCount;
+        }
+        // One edge per callee per line
+        const char* start = text + token->offset;
+        int len = token->length;
+        int slot = findLineCallSlot(graph, set, capacity - 1, lineStart, start, len);
+        if (set[slot] >= lineStart)
+            continue;
+        addCallSite(graph, caller, start, len, token->line);
+        set[slot] = graph->callCount - 1;
+        if ((graph->callCount - lineStart) * 2 > capacity) {
+            // Keep the set at most half full: rehash this line's calls into a bigger one
+            capacity *= 2;
+            free(set);
+            set = (int*)malloc(sizeof(int) * capacity);
+            if (set == NULL) {
+                printf("Memory allocation failed!\n");
+                exit(1);
+            }
+            for (int i = 0; i < capacity; i++)
+                set[i] = -1;
+            for (int c = lineStart; c < graph->callCount; c++) {
+                const char* callee = graph->calleePool + graph->calls[c].calleeOffset;
+                set[findLineCallSlot(graph, set, capacity - 1, lineStart, callee, strlen(callee))] = c;
             }
         }
     }
-    fclose(file);
+    free(set);
+}
 
-    // Check for cycles
-    for (int i = 0; i < funcCount; i++) {
-        // Reset visited and recStack for each new DFS traversal root
-        for (int j = 0; j < funcCount; j++) {
-            visited[j] = 0;
-            recStack[j] = 0;
+// A call between two functions of the same strongly connected component
+typedef struct CycleEdge {
+    int from;
+    int to;
+    int call_line_number;
+    int file;
+} CycleEdge;
+
+int compareCycleEdges(const void* a, const void* b) {
+    const CycleEdge* x = (const CycleEdge*)a;
+    const CycleEdge* y = (const CycleEdge*)b;
+    if (x->file != y->file)
+        return x->file - y->file;
+    if (x->call_line_number != y->call_line_number)
+        return x->call_line_number - y->call_line_number;
+    if (x->from != y->from)
+        return x->from - y->from;
+    return x->to - y->to;
+}
+
+// " of FILE" after a line number in a graph of several files, "" otherwise
+const char* lineFileSeparator(const CallGraph* graph) {
+    return graph->fileCount > 0 ? " of " : "";
+}
+
+const char* lineFile(const CallGraph* graph, const CycleEdge* edge) {
+    return graph->fileCount > 0 ? graph->files[edge->file] : "";
+}
+
+// One finding per self-recursive call, or one per group of mutually recursive
+// functions with every call of the cycle folded into a single-line message. In a
+// graph of several files a finding belongs to the file of its first call.
+void writeCycleFinding(const CallGraph* graph, int* members, int memberCount,
+                       CycleEdge* edges, int edgeCount, FindingWriter* writer) {
+    size_t capacity = 64;
+    for (int m = 0; m < memberCount; m++)
+        capacity += strlen(functionName(graph, members[m])) + 8;
+    for (int e = 0; e < edgeCount; e++)
+        capacity += strlen(functionName(graph, edges[e].from)) + strlen(functionName(graph, edges[e].to)) +
+                    strlen(lineFile(graph, &edges[e])) + 44;
+    char* message = (char*)malloc(capacity);
+    if (message == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    const char* file = writer->file;
+    if (memberCount == 1) {
+        for (int e = 0; e < edgeCount; e++) {
+            snprintf(message, capacity, "Function '%s' calling function '%s' on line %d%s%s forms a cycle.",
+                     functionName(graph, edges[e].from), functionName(graph, edges[e].to), edges[e].call_line_number,
+                     lineFileSeparator(graph), lineFile(graph, &edges[e]));
+            if (graph->fileCount > 0)
+                writer->file = lineFile(graph, &edges[e]);
+            writeFinding(writer, SEVERITY_ERROR, "Infinite Recursion", edges[e].call_line_number, message);
+        }
+        writer->file = file;
+        free(message);
+        return;
+    }
+
+    size_t len = snprintf(message, capacity, "Functions ");
+    for (int m = 0; m < memberCount; m++) {
+        len += snprintf(message + len, capacity - len, "%s'%s'",
+                        m == 0 ? "" : (m == memberCount - 1 ? " and " : ", "), functionName(graph, members[m]));
+    }
+    len += snprintf(message + len, capacity - len, " call each other in a cycle:");
+    for (int e = 0; e < edgeCount; e++) {
+        len += snprintf(message + len, capacity - len, "%s '%s' calls '%s' on line %d%s%s",
+                        e == 0 ? "" : ";", functionName(graph, edges[e].from), functionName(graph, edges[e].to),
+                        edges[e].call_line_number, lineFileSeparator(graph), lineFile(graph, &edges[e]));
+    }
+    if (graph->fileCount > 0)
+        writer->file = lineFile(graph, &edges[0]);
+    writeFinding(writer, SEVERITY_ERROR, "Infinite Recursion", edges[0].call_line_number, message);
+    writer->file = file;
+    free(message);
+}
+
+// Reports one recursive component: its members and every call that keeps it cycling.
+void reportCycle(const CallGraph* graph, int* members, int memberCount, int* component, FindingWriter* writer) {
+    int edgeCount = 0;
+    for (int m = 0; m < memberCount; m++) {
+        int v = members[m];
+        for (int e = graph->edgeStart[v]; e < graph->edgeStart[v + 1]; e++) {
+            if (component[graph->edgeTarget[e]] == component[v])
+                edgeCount++;
+        }
+    }
+    if (edgeCount == 0)
+        return; // A single function that never calls itself
+
+    CycleEdge* edges = (CycleEdge*)malloc(sizeof(CycleEdge) * edgeCount);
+    int n = 0;
+    for (int m = 0; m < memberCount; m++) {
+        int v = members[m];
+        for (int e = graph->edgeStart[v]; e < graph->edgeStart[v + 1]; e++) {
+            if (component[graph->edgeTarget[e]] == component[v]) {
+                edges[n].from = v;
+                edges[n].to = graph->edgeTarget[e];
+                edges[n].call_line_number = graph->edgeLine[e];
+                edges[n].file = graph->edgeFile[e];
+                n++;
+            }
         }
-        if (isCyclic(i)) {
-            // The specific cycle detection message is now printed within isCyclic.
-            // Clean up allocated memory and exit.
-            for(int k=0; k < funcCount; ++k) {
-                Node* current = adjList[k];
-                while(current != NULL) {
-                    Node* next = current->next;
-                    free(current);
-                    current = next;
+    }
+    qsort(edges, edgeCount, sizeof(CycleEdge), compareCycleEdges);
+
+    if (writer->format != OUTPUT_TEXT) {
+        writeCycleFinding(graph, members, memberCount, edges, edgeCount, writer);
+        free(edges);
+        return;
+    }
+
+    FILE* out = writer->out;
+    if (memberCount == 1) {
+        for (int e = 0; e < edgeCount; e++) {
+            fprintf(out, "⚠️ Infinite recursion detected: Function '%s' calling function '%s' on line %d%s%s forms a cycle.\n",
+                   functionName(graph, edges[e].from), functionName(graph, edges[e].to), edges[e].call_line_number,
+                   lineFileSeparator(graph), lineFile(graph, &edges[e]));
+        }
+    } else {
+        fprintf(out, "⚠️ Infinite recursion detected: Functions ");
+        for (int m = 0; m < memberCount; m++) {
+            fprintf(out, "%s'%s'", m == 0 ? "" : (m == memberCount - 1 ? " and " : ", "), functionName(graph, members[m]));
+        }
+        fprintf(out, " call each other in a cycle.\n");
+        for (int e = 0; e < edgeCount; e++) {
+            fprintf(out, "    '%s' calls '%s' on line %d%s%s\n",
+                   functionName(graph, edges[e].from), functionName(graph, edges[e].to), edges[e].call_line_number,
+                   lineFileSeparator(graph), lineFile(graph, &edges[e]));
+        }
+    }
+    free(edges);
+}
+
+// Tarjan's strongly connected components, iterative so that deep call chains cannot
+// overflow the C stack. Every function and call is visited once: O(V + E).
+// Reports every recursive component and returns how many were found.
+int findRecursiveCycles(const CallGraph* graph, FindingWriter* writer) {
+    StatsMark mark = statsEnter(STAGE_RECURSION);
+    int funcCount = graph->funcCount;
+    size_t size = sizeof(int) * (funcCount + 1);
+    int* index = (int*)malloc(size);
+    int* lowlink = (int*)malloc(size);
+    int* onStack = (int*)malloc(size);
+    int* component = (int*)malloc(size);
+    int* sccStack = (int*)malloc(size);
+    int* callStack = (int*)malloc(size);   // DFS path, replaces recursion
+    int* nextEdge = (int*)malloc(size);    // Resume point in each function's calls
+    if (!index || !lowlink || !onStack || !component || !sccStack || !callStack || !nextEdge) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    int sccTop = 0, nextIndex = 0, componentCount = 0;
+
+    for (int i = 0; i < funcCount; i++) {
+        index[i] = -1;
+        onStack[i] = 0;
+        component[i] = -1;
+    }
+
+    for (int root = 0; root < funcCount; root++) {
+        if (index[root] != -1)
+            continue;
+        int depth = 0;
+        callStack[depth++] = root;
+        index[root] = lowlink[root] = nextIndex++;
+        sccStack[sccTop++] = root;
+        onStack[root] = 1;
+        nextEdge[root] = graph->edgeStart[root];
+
+        while (depth > 0) {
+            int v = callStack[depth - 1];
+            if (nextEdge[v] < graph->edgeStart[v + 1]) {
+                int w = graph->edgeTarget[nextEdge[v]++];
+                if (index[w] == -1) {
+                    index[w] = lowlink[w] = nextIndex++;
+                    sccStack[sccTop++] = w;
+                    onStack[w] = 1;
+                    nextEdge[w] = graph->edgeStart[w];
+                    callStack[depth++] = w;
+                } else if (onStack[w] && index[w] < lowlink[v]) {
+                    lowlink[v] = index[w];
                 }
-                adjList[k] = NULL; // Avoid dangling pointers
+                continue;
+            }
+
+            // All calls from v explored
+            depth--;
+            if (depth > 0) {
+                int parent = callStack[depth - 1];
+                if (lowlink[v] < lowlink[parent])
+                    lowlink[parent] = lowlink[v];
+            }
+            if (lowlink[v] == index[v]) {
+                int w;
+                do {
+                    w = sccStack[--sccTop];
+                    onStack[w] = 0;
+                    component[w] = componentCount;
+                } while (w != v);
+                componentCount++;
             }
-            return; // Exit after first detection to avoid redundant messages or deeper issues.
         }
     }
 
-    // If we reach here, no cycles were detected by any DFS run.
-    printf("✅ No infinite recursion detected.\n"); 
-    // Clean up allocated memory if no cycle was found and program didn't exit early
-     for(int i=0; i < funcCount; ++i) {
-        Node* current = adjList[i];
-        while(current != NULL) {
-            Node* next = current->next;
-            free(current);
-            current = next;
+    // Report components in order of their first-defined member, members in definition order
+    // (bucketed by a counting sort to stay linear). The Tarjan work arrays are reused.
+    int cycles = 0;
+    int* members = sccStack;
+    int* start = (int*)calloc(componentCount + 1, sizeof(int));
+    int* fill = index;
+    int* reported = onStack;
+    for (int i = 0; i < funcCount; i++)
+        start[component[i] + 1]++;
+    for (int c = 0; c < componentCount; c++) {
+        start[c + 1] += start[c];
+        fill[c] = start[c];
+        reported[c] = 0;
+    }
+    for (int i = 0; i < funcCount; i++)
+        members[fill[component[i]]++] = i;
+
+    for (int i = 0; i < funcCount; i++) {
+        int c = component[i];
+        if (reported[c])
+            continue;
+        reported[c] = 1;
+        int memberCount = start[c + 1] - start[c];
+        int isRecursive = memberCount > 1;
+        for (int e = graph->edgeStart[i]; !isRecursive && e < graph->edgeStart[i + 1]; e++) {
+            if (graph->edgeTarget[e] == i)
+                isRecursive = 1;
         }
-        adjList[i] = NULL;
+        if (isRecursive) {
+            reportCycle(graph, members + start[c], memberCount, component, writer);
+            cycles++;
+        }
+    }
+    free(start);
+    free(index);
+    free(lowlink);
+    free(onStack);
+    free(component);
+    free(sccStack);
+    free(callStack);
+    free(nextEdge);
+    statsLeave(mark, 0);
+    return cycles;
+}
+
+// Gathers the definitions and call sites of a lexed source; buildCallGraph
+// resolves them. Calls are the ones made inside each function's body. Only the
+// definitions found scanning from token from up to token to are read: from must
+// be where the scan of the whole file would pass, such as a function's scan_token.
+CallGraph* readCallGraphRange(const LexedSource* lexed, int from, int to) {
+    StatsMark mark = statsEnter(STAGE_RECURSION);
+    CallGraph* graph = createCallGraph();
+    int next = from, name, body, body_end;
+    while (next < to && nextFunctionDefinition(lexed, &next, &name, &body, &body_end) && name < to) {
+        const LexToken* token = &lexed->tokens[name];
+        int caller = getFunctionIndexLength(graph, lexed->source.data + token->offset, token->length);  // Register function
+        collectCalls(graph, lexed, body + 1, body_end, caller);
     }
-}
\ No newline at end of file
+    int lines = lexed->line_count;
+    if (from > 0 || to < lexed->count) {
+        int last = to < lexed->count ? lexed->tokens[to].line : lexed->first_line + lexed->line_count;
+        lines = from < to ? last - lexed->tokens[from].line : 0;
+    }
+    statsLeave(mark, lines);
+    return graph;
+}
+
+CallGraph* readCallGraph(const LexedSource* lexed) {
+    return readCallGraphRange(lexed, 0, lexed->count);
+}
+
+// Reads a file and builds its call graph. Returns NULL if the file can't be opened.
+CallGraph* extractCallGraph(const char* filename) {
+    LexedSource lexed;
+    if (!openLexedFile(filename, &lexed)) {
+        return NULL;
+    }
+    CallGraph* graph = readCallGraph(&lexed);
+    closeLexedSource(&lexed);
+    buildCallGraph(graph);
+    return graph;
+}
+
+// Adds the definitions and unresolved call sites of part (e.g. one function's
+// graph) to graph, keeping definition order. Call graph must not be built yet.
+void mergeCallGraph(CallGraph* graph, const CallGraph* part) {
+    int* index = (int*)malloc(sizeof(int) * (part->funcCount + 1));
+    if (index == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (int f = 0; f < part->funcCount; f++)
+        index[f] = getFunctionIndex(graph, functionName(part, f));
+    for (int i = 0; i < part->callCount; i++) {
+        const char* callee = part->calleePool + part->calls[i].calleeOffset;
+        addCallSiteInFile(graph, index[part->calls[i].caller], callee, strlen(callee),
+                          part->calls[i].call_line_number, part->calls[i].file);
+    }
+    free(index);
+}
+
+// Whether the function defined at token name is declared static: whether the
+// declaration it is in, which starts after the previous ';', brace or directive,
+// says so.
+int isStaticDefinition(const LexedSource* lexed, int name) {
+    const char* text = lexed->source.data;
+    for (int i = name - 1; i >= 0; i--) {
+        const LexToken* token = &lexed->tokens[i];
+        if (token->kind == LEX_DIRECTIVE || isPunct(text, token, ';') || isPunct(text, token, '{') ||
+            isPunct(text, token, '}'))
+            return 0;
+        if (token->kind == LEX_IDENTIFIER && token->length == 6 && memcmp(text + token->offset, "static", 6) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// The static functions of a lexed source, as a graph of definitions without calls
+CallGraph* readStaticFunctions(const LexedSource* lexed) {
+    CallGraph* statics = createCallGraph();
+    int next = 0, name, body, body_end;
+    while (nextFunctionDefinition(lexed, &next, &name, &body, &body_end)) {
+        const LexToken* token = &lexed->tokens[name];
+        if (isStaticDefinition(lexed, name))
+            getFunctionIndexLength(statics, lexed->source.data + token->offset, token->length);
+    }
+    return statics;
+}
+
+// Name under which a function of file is merged: a static one, listed in
+// statics, is only visible in its own file and is merged as name@file. Returns
+// name itself or key, which must be free()d.
+const char* unitFunctionKey(const CallGraph* graph, const CallGraph* statics, int file, const char* name,
+                            char** key) {
+    *key = NULL;
+    if (lookupFunctionIndex(statics, name, strlen(name)) == -1)
+        return name;
+    *key = (char*)malloc(strlen(name) + strlen(graph->files[file]) + 2);
+    if (*key == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    sprintf(*key, "%s@%s", name, graph->files[file]);
+    return *key;
+}
+
+// Adds the graph of one translation unit, part, to the graph of a project, with
+// its calls in file (from addCallGraphFile). Functions are merged by name, so
+// calls resolve across files, except for the static functions of the unit:
+// those are merged as name@file, and only the unit's own calls resolve to them.
+void mergeUnitCallGraph(CallGraph* graph, const CallGraph* part, const CallGraph* statics, int file) {
+    int* index = (int*)malloc(sizeof(int) * (part->funcCount + 1));
+    if (index == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    char* key;
+    for (int f = 0; f < part->funcCount; f++) {
+        index[f] = getFunctionIndex(graph, unitFunctionKey(graph, statics, file, functionName(part, f), &key));
+        free(key);
+    }
+    for (int i = 0; i < part->callCount; i++) {
+        const char* callee = unitFunctionKey(graph, statics, file, part->calleePool + part->calls[i].calleeOffset, &key);
+        addCallSiteInFile(graph, index[part->calls[i].caller], callee, strlen(callee), part->calls[i].call_line_number,
+                          file);
+        free(key);
+    }
+    free(index);
+}
+
+// Reports the cycles of a built call graph, or in text mode that there are none.
+void reportRecursion(const CallGraph* graph, FindingWriter* writer) {
+    if (findRecursiveCycles(graph, writer) == 0 && writer->format == OUTPUT_TEXT) {
+        fprintf(writer->out, "✅ No infinite recursion detected.\n");
+    }
+}
+
+// Driver function to detect infinite recursion
+void detectInfiniteRecursion(const char* filename, FindingWriter* writer) {
+    CallGraph* graph = extractCallGraph(filename);
+    if (graph == NULL) {
+        writeMessage(writer, "Error opening file.\n");
+        return;
+    }
+    reportRecursion(graph, writer);
+    freeCallGraph(graph);
+}
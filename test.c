@@ -2,8 +2,31 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <limits.h>
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#include "Stats.c"
+#include "SourceFile.c"
+#include "Lexer.c"
+#include "Declarations.c"
+#include "FindingWriter.c"
 #include "VariableExtractor.c"
 #include "infiniterecursion.c"
+#include "KeywordMatcher.c"
+#include "ThreadPool.c"
+#include "CompileCommands.c"
+#include "CallIndex.c"
+#include "HeaderCache.c"
 
 typedef struct token{
     char type[50];
@@ -12,12 +35,36 @@ typedef struct token{
     struct token *next;
 } token;
 
-token* CreateToken(char* type, int line_num, char* description) {
-    token* newtoken = (token*)malloc(sizeof(token));
-    if(newtoken == NULL) {
-        printf("Memory allocation failed.\n");
-        exit(1);
+// Tokens are carved out of fixed-size blocks instead of being malloc'd one by
+// one, and the list keeps a tail pointer, so adding a finding is O(1) and the
+// whole list is freed a block at a time.
+#define TOKEN_BLOCK_SIZE 256
+
+typedef struct TokenBlock {
+    struct TokenBlock* next;
+    int used;
+    token tokens[TOKEN_BLOCK_SIZE];
+} TokenBlock;
+
+typedef struct TokenList {
+    token* head;
+    token* tail;
+    TokenBlock* blocks;      // Newest block first
+    FindingWriter* writer;   // When set, findings are streamed out instead of kept
+} TokenList;
+
+token* CreateToken(TokenList* list, char* type, int line_num, char* description) {
+    if(list->blocks == NULL || list->blocks->used == TOKEN_BLOCK_SIZE) {
+        TokenBlock* block = (TokenBlock*)malloc(sizeof(TokenBlock));
+        if(block == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        block->used = 0;
+        block->next = list->blocks;
+        list->blocks = block;
     }
+    token* newtoken = &list->blocks->tokens[list->blocks->used++];
 
     strcpy(newtoken->type, type);
     newtoken->line_num = line_num;
@@ -27,474 +74,2917 @@ token* CreateToken(char* type, int line_num, char* description) {
     return newtoken;
 }
 
-void AddToken(token** head, char* type, int line_num, char* descripton) {
-    token* newtoken = CreateToken(type, line_num, descripton);
-    if(*head == NULL) {
-        *head = newtoken;
+void AddToken(TokenList* list, char* type, int line_num, char* descripton) {
+    if(list->writer != NULL) {
+        writeFinding(list->writer, SEVERITY_WARNING, type, line_num, descripton);
         return;
     }
+    token* newtoken = CreateToken(list, type, line_num, descripton);
+    if(list->tail == NULL) {
+        list->head = newtoken;
+    }
     else {
-        token* current = *head;
-        while(current->next != NULL) {
-            current = current->next;
-        }
-        current->next = newtoken;
+        list->tail->next = newtoken;
     }
+    list->tail = newtoken;
 }
 
-void ShowTokens(token* head) {
+void ShowTokens(token* head, FILE* out) {
     if(head == NULL) {
-        printf("No tokens found.\n");
+        fprintf(out, "No tokens found.\n");
         return;
     }
-    printf("Bug Detected:\n");
+    fprintf(out, "Bug Detected:\n");
     token* current = head;
     while(current!= NULL) {
-        printf("Token Type: %s\n", current->type);
-        printf("Line Number: %d\n", current->line_num);
-        printf("Description: %s\n", current->description);
-        printf("\n");
+        fprintf(out, "Token Type: %s\n", current->type);
+        fprintf(out, "Line Number: %d\n", current->line_num);
+        fprintf(out, "Description: %s\n", current->description);
+        fprintf(out, "\n");
         current = current->next;
     }
 }
 
-void delete_tokens(token* head){
-    token* current = head;
-    token* next;
+void delete_tokens(TokenList* list){
+    TokenBlock* current = list->blocks;
+    TokenBlock* next;
     while(current != NULL){
         next = current->next;
         free(current);
         current = next;
     }
+    list->head = NULL;
+    list->tail = NULL;
+    list->blocks = NULL;
 }
 
-void analyse_code(const char* code, token** tokenList) {
-    FILE* file = fopen(code, "r");
-    if(file == NULL){
-        printf("Error opening file. Please check the file name and try again.\n testcase.txt\n");
+// Moves every token of other to the end of list, along with the blocks holding them.
+void AppendTokens(TokenList* list, TokenList* other) {
+    if(other->head == NULL) {
         return;
     }
-
-    char line[100];
-    int line_num = 1;
-
-    
-{    // Stack to track opening brackets
-    char stack[100];
-    int top = -1;
-    int bracket_positions[100]; // Store line numbers of opening brackets
-    while(fgets(line, sizeof(line), file) != NULL){
-        for(int i = 0; i < strlen(line); i++) {
-            // Check for opening brackets
-            if(line[i] == '(' || line[i] == '{' || line[i] == '[') {
-                // Push to stack
-                top++;
-                stack[top] = line[i];
-                bracket_positions[top] = line_num;
-            }
-            // Check for closing brackets
-            else if(line[i] == ')' || line[i] == '}' || line[i] == ']') {
-                // If stack is empty, we have an extra closing bracket
-                if(top == -1) {
-                    char description[100];
-                    sprintf(description, "Unexpected closing bracket '%c' with no matching opening bracket", line[i]);
-                    AddToken(tokenList, "Bracket Error", line_num, description);
-                }
-                // Check if brackets match
-                else {
-                    char expected_bracket;
-                    if(line[i] == ')') expected_bracket = '(';
-                    else if(line[i] == '}') expected_bracket = '{';
-                    else expected_bracket = '[';
-                    
-                    if(stack[top] != expected_bracket) {
-                        char description[100];
-                        sprintf(description, "Mismatched bracket: expected '%c' but found '%c'", 
-                                stack[top] == '(' ? ')' : (stack[top] == '{' ? '}' : ']'), line[i]);
-                        AddToken(tokenList, "Bracket Error", line_num, description);
-                    }
-                    top--; // Pop from stack regardless
-                }
-            }
-        }
-        line_num++;
+    if(list->tail == NULL) {
+        list->head = other->head;
+    }
+    else {
+        list->tail->next = other->head;
     }
+    list->tail = other->tail;
 
-    // Check for unclosed brackets
-    while(top >= 0) {
-        char description[100];
-        char expected_bracket;
-        if(stack[top] == '(') expected_bracket = ')';
-        else if(stack[top] == '{') expected_bracket = '}';
-        else expected_bracket = ']';
-        sprintf(description, "Unclosed bracket '%c' - missing '%c'", stack[top], expected_bracket);
-        AddToken(tokenList, "Bracket Error", bracket_positions[top], description);
-        top--;
-    }}
+    TokenBlock* last = other->blocks;
+    while(last->next != NULL) {
+        last = last->next;
+    }
+    last->next = list->blocks;
+    list->blocks = other->blocks;
 
-    line_num = 1;
-    fseek(file, 0, SEEK_SET); // Reset file pointer to the beginning
+    other->head = NULL;
+    other->tail = NULL;
+    other->blocks = NULL;
+}
 
-    // Track if we're inside a struct definition
-    int in_struct_definition = 0;
+// Adds a finding right after the token after, or first in the list if after is NULL.
+token* InsertTokenAfter(TokenList* list, token* after, char* type, int line_num, char* description) {
+    token* newtoken = CreateToken(list, type, line_num, description);
+    if(after == NULL) {
+        newtoken->next = list->head;
+        list->head = newtoken;
+    }
+    else {
+        newtoken->next = after->next;
+        after->next = newtoken;
+    }
+    if(newtoken->next == NULL) {
+        list->tail = newtoken;
+    }
+    return newtoken;
+}
 
-    while(fgets(line, sizeof(line), file)!= NULL){
-        //writing the exception cases for missing semicolons which are made to beautify the code or like whitelines and comments.
-        if(line[0] == '\n' || (line[0] == '/' && line[1] == '/') || (line[0] == '/' && line[1] == '*') || (line[0] == '*' && line[1] == '/')){
-            line_num++;
+// Unlinks the given tokens, which are in list order, from the list.
+void RemoveTokens(TokenList* list, token** tokens, int count) {
+    token* previous = NULL;
+    int next = 0;
+    for(token* current = list->head; current != NULL && next < count; current = current->next) {
+        if(current != tokens[next]) {
+            previous = current;
             continue;
         }
-
-        //skip preprocessor directives
-        if(line[0] == '#'){
-            line_num++;
-            continue;
+        next++;
+        if(previous == NULL) {
+            list->head = current->next;
         }
-
-        // Check if entering or exiting a struct definition
-        if(strstr(line, "struct") && strstr(line, "{")) {
-            in_struct_definition = 1;
+        else {
+            previous->next = current->next;
         }
-        if(strstr(line, "}") && in_struct_definition) {
-            in_struct_definition = 0;
+        if(list->tail == current) {
+            list->tail = previous;
         }
+    }
+}
 
-        {int len = strlen(line);
-        int should_have_semicolon = 0;
+// Moves every token of other into list, both being in line order, keeping the
+// result in line order; on equal lines list's tokens come first.
+void MergeTokensByLine(TokenList* list, TokenList* other) {
+    if(other->head == NULL) {
+        return;
+    }
+    token* a = list->head;
+    token* b = other->head;
+    token* head = NULL;
+    token** tail = &head;
+    token* last = NULL;
+    while(a != NULL || b != NULL) {
+        token** first = b == NULL || (a != NULL && a->line_num <= b->line_num) ? &a : &b;
+        last = *first;
+        *tail = last;
+        tail = &last->next;
+        *first = last->next;
+    }
+    list->head = head;
+    list->tail = last;
 
-        //remove trailing whitespace
-        while(len > 0 && (isspace(line[len - 1]) || line[len - 1] == '\t')){
-            line[len - 1] = '\0';
-            len--;
-        }
+    TokenBlock* block = other->blocks;
+    while(block->next != NULL) {
+        block = block->next;
+    }
+    block->next = list->blocks;
+    list->blocks = other->blocks;
 
-        if(len == 0){
-            line_num++;
-            continue;
-        }
+    other->head = NULL;
+    other->tail = NULL;
+    other->blocks = NULL;
+}
 
-        //Check if the line should end with a semicolon
-        if(strstr(line, "return") ||
-           strstr(line, "printf") ||
-        strstr(line, "scanf") ||
-        strstr(line, "malloc") ||
-        strstr(line, "free") ||
-        strstr(line, "calloc") ||
-        strstr(line, "realloc") ||
-        strstr(line, "exit") ||
-        strstr(line, "abort") ||
-        strstr(line, "atexit") ||
-        strstr(line, "strcpy") ||
-        strstr(line, "strcat") ||
-        strstr(line, "strlen") ||
-        strstr(line, "strcmp") ||
-        strstr(line, "strncpy") ||
-        strstr(line, "strncat") ||
-        strstr(line, "strncmp") ||
-        strstr(line, "strstr") ||
-        strstr(line, "strchr") ||
-        strstr(line, "strrchr") ||
-        strstr(line, "strspn") ||
-        strstr(line, "strcspn") ||
-        strstr(line, "strpbrk") ||
-        strstr(line, "strtok") ||
-        strstr(line, "strerror") ||
-        strstr(line, "strtol") ||
-        strstr(line, "strtoul") ||
-        strstr(line, "strtod") ||
-        strstr(line, "++") ||
-        strstr(line, "=") ||
-        strstr(line, "+=") ||
-        strstr(line, "-=") ||
-        strstr(line, "*=") ||
-        strstr(line, "/=") ||
-        strstr(line, "%=") ||
-        strstr(line, "&=") ||
-        strstr(line, "|=") ||
-        strstr(line, "^=") ||
-        strstr(line, "?")){
-
-            //exclude lines that shouldnt end with a semicolon
-            if(strstr(line, "{") || strstr(line, "}") || 
-            strstr(line, "if") || strstr(line, "else") || 
-            (strstr(line, "for") && strchr(line, '(')) || (strstr(line, "while") && strchr(line, '(')) || // More specific for loops/whiles
-            strstr(line, "#include") || strstr(line, "#define")) {
-             should_have_semicolon = 0;
-         } else {
-             should_have_semicolon = 1; // Semicolon needed
-         }
-        }
-
-        //check for variable and function declaration
-        if((strstr(line, "int ") || strstr(line, "char ") ||
-           strstr(line, "float ") || strstr(line, "double ") ||
-           strstr(line, "void ") || strstr(line, "struct ")) &&
-           !strstr(line, "{")) {
-            should_have_semicolon = 1;
-        }
-
-        //check if the line is ending with a semicolon
-        if(should_have_semicolon && !in_struct_definition && line[len - 1] != ';'){
-            char description[100];
-            sprintf(description, "Missing semicolon at the end of line %d", line_num);
-            AddToken(tokenList, "Missing Semicolon", line_num, description);
-        }
+// A closing bracket a chunk of a split file found with its own stack empty. Whether
+// it matches is only known once the chunks before it are put together.
+typedef struct PendingBracket {
+    char bracket;
+    int line_num;
+    token* after;            // Last finding before it in the chunk's list, NULL if none
+} PendingBracket;
 
-        //check for missing semicolons in for loop
-        if(strstr(line, "for") && !strstr(line, ";")){
-            char description[100];
-            sprintf(description, "Missing semicolon in for loop at line %d", line_num);
-            AddToken(tokenList, "Missing Semicolon", line_num, description);
+// State carried between lines by the bracket matcher.
+typedef struct BracketState {
+    char* stack;
+    int top;
+    int capacity;
+    int* bracket_positions; // Store line numbers of opening brackets
+    int defer;              // A chunk: closing brackets with the stack empty are pending
+    PendingBracket* pending;
+    int pending_count;
+    int pending_capacity;
+} BracketState;
+
+void push_bracket(BracketState* state, char bracket, int line_num) {
+    // Push to stack, growing it for deeply nested (e.g. minified) code
+    if(state->top + 1 == state->capacity) {
+        state->capacity = state->capacity ? state->capacity * 2 : 100;
+        state->stack = (char*)realloc(state->stack, state->capacity);
+        state->bracket_positions = (int*)realloc(state->bracket_positions, sizeof(int) * state->capacity);
+        if(state->stack == NULL || state->bracket_positions == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
         }
+    }
+    state->top++;
+    state->stack[state->top] = bracket;
+    state->bracket_positions[state->top] = line_num;
+}
 
-        //check for extra semicolons
-        int in_string = 0;
-        int consecutive_semicolons = 0;
-        for(int i = 0; i < len; i++) {
-            if(line[i] == '"') {
-                in_string = !in_string;
-            }
-            if(!in_string && line[i] == ';') {
-                consecutive_semicolons++;
-                if(consecutive_semicolons > 1) {
-                    char description[100];
-                    sprintf(description, "Extra semicolon at line %d", line_num);
-                    AddToken(tokenList, "Extra Semicolon", line_num, description);
-                    consecutive_semicolons = 0;
+// Matches a closing bracket against the stack. Returns 1 and fills description
+// if it is an error.
+int close_bracket(BracketState* state, char bracket, char* description) {
+    // If stack is empty, we have an extra closing bracket
+    if(state->top == -1) {
+        sprintf(description, "Unexpected closing bracket '%c' with no matching opening bracket", bracket);
+        return 1;
+    }
+    // Check if brackets match
+    char expected_bracket;
+    if(bracket == ')') expected_bracket = '(';
+    else if(bracket == '}') expected_bracket = '{';
+    else expected_bracket = '[';
+
+    int mismatched = state->stack[state->top] != expected_bracket;
+    if(mismatched) {
+        char top_bracket = state->stack[state->top];
+        sprintf(description, "Mismatched bracket: expected '%c' but found '%c'",
+                top_bracket == '(' ? ')' : (top_bracket == '{' ? '}' : ']'), bracket);
+    }
+    state->top--; // Pop from stack regardless
+    return mismatched;
+}
+
+void check_brackets(BracketState* state, const LexLine* line, TokenList* tokenList) {
+    int line_num = line->number;
+    for(int t = 0; t < line->count; t++) {
+        if(line->tokens[t].kind != LEX_PUNCT || line->tokens[t].length != 1) {
+            continue;
+        }
+        char c = line->text[line->tokens[t].offset];
+        // Check for opening brackets
+        if(c == '(' || c == '{' || c == '[') {
+            push_bracket(state, c, line_num);
+        }
+        // Check for closing brackets
+        else if(c == ')' || c == '}' || c == ']') {
+            if(state->top == -1 && state->defer) {
+                if(state->pending_count == state->pending_capacity) {
+                    state->pending_capacity = state->pending_capacity ? state->pending_capacity * 2 : 16;
+                    state->pending = (PendingBracket*)realloc(state->pending, sizeof(PendingBracket) * state->pending_capacity);
+                    if(state->pending == NULL) {
+                        printf("Memory allocation failed!\n");
+                        exit(1);
+                    }
                 }
-            } else if(!in_string && !isspace(line[i])){
-                consecutive_semicolons = 0;
+                PendingBracket* pending = &state->pending[state->pending_count++];
+                pending->bracket = c;
+                pending->line_num = line_num;
+                pending->after = tokenList->tail;
+                continue;
             }
-        }
-        line_num++;
-    }}
-    fseek(file, 0, SEEK_SET); // Reset file pointer to the beginning
-    line_num = 1;
-    {while(fgets(line, sizeof(line), file)!= NULL){
-        if(strstr(line, "/0") || strstr(line, "%0") || strstr(line, "/ 0") || strstr(line, "% 0") || strstr(line, "0 %") ||strstr(line, "0%")) {
             char description[100];
-            sprintf(description, "Division by zero at line %d", line_num);
-            AddToken(tokenList, "Division by Zero", line_num, description);
+            if(close_bracket(state, c, description)) {
+                AddToken(tokenList, "Bracket Error", line_num, description);
+            }
         }
-        line_num++;
-    }}
-    fseek(file, 0, SEEK_SET); // Reset file pointer to the beginning
-    line_num = 1;
+    }
+}
 
-    while(fgets(line, sizeof(line), file)!= NULL){
-        //unsafe gets
-        if(strstr(line, "gets")){
-            char description[100];
-            sprintf(description, "Unsafe option of using gets Instead use fgets at line: %d", line_num);
-            AddToken(tokenList, "unsafe option", line_num, description);
-        }
+void check_unclosed_brackets(BracketState* state, TokenList* tokenList) {
+    while(state->top >= 0) {
+        char description[100];
+        char expected_bracket;
+        if(state->stack[state->top] == '(') expected_bracket = ')';
+        else if(state->stack[state->top] == '{') expected_bracket = '}';
+        else expected_bracket = ']';
+        sprintf(description, "Unclosed bracket '%c' - missing '%c'", state->stack[state->top], expected_bracket);
+        AddToken(tokenList, "Bracket Error", state->bracket_positions[state->top], description);
+        state->top--;
+    }
+}
 
-        if (strstr(line, "strcpy") != NULL || strstr(line, "strcat") != NULL || strstr(line, "strcmp") != NULL) {
-            if (strstr(line, "strncpy") == NULL || strstr(line, "strncat") == NULL || strstr(line, "strncmp") == NULL) {
-                char description[100];
-                sprintf(description, "Buffer overflow: Unsafe String operation without bounds checking");
-                AddToken(tokenList, "Buffer Overflow", line_num, description);
-                if(strstr(line, "(") == NULL || strstr(line, ")") == NULL) {
-                    char description[100];
-                    sprintf(description, "Missing arguments for strcpy or strcat at line %d", line_num);
-                    AddToken(tokenList, "Missing Arguments", line_num, description);
-                }
-            }else{
-            if(strstr(line, "(") == NULL || strstr(line, ")") == NULL) {
+// Keyword table for the semicolon checks. Every entry is a whole token, so a
+// line's keywords are found with one lookup per token however many there are.
+const char* semicolon_required_keywords[] = {
+    "return", "printf", "scanf", "malloc", "free", "calloc", "realloc", "exit",
+    "abort", "atexit", "strcpy", "strcat", "strlen", "strcmp", "strncpy", "strncat",
+    "strncmp", "strstr", "strchr", "strrchr", "strspn", "strcspn", "strpbrk", "strtok",
+    "strerror", "strtol", "strtoul", "strtod", "++", "=", "+=", "-=",
+    "*=", "/=", "%=", "&=", "|=", "^=", "?"
+};
+// Lines containing these shouldn't end with a semicolon
+const char* semicolon_excluded_keywords[] = {
+    "{", "}", "if", "else"
+};
+// Variable and function declarations
+const char* declaration_keywords[] = {
+    "int", "char", "float", "double", "void", "struct"
+};
+
+#define KEYWORD_COUNT(table) ((int)(sizeof(table) / sizeof(table[0])))
+
+KeywordMatcher* semicolon_matcher = NULL;
+uint64_t semicolon_required_mask = 0;
+uint64_t semicolon_excluded_mask = 0;
+uint64_t declaration_mask = 0;
+uint64_t open_brace_bit, for_bit, while_bit, open_paren_bit, semicolon_bit;
+pthread_once_t semicolon_matcher_once = PTHREAD_ONCE_INIT;
+
+uint64_t add_keywords(const char** patterns, int* count, const char** keywords, int keyword_count) {
+    uint64_t mask = 0;
+    for (int i = 0; i < keyword_count; i++) {
+        mask |= (uint64_t)1 << *count;
+        patterns[(*count)++] = keywords[i];
+    }
+    return mask;
+}
+
+void build_semicolon_matcher() {
+    const char* patterns[MAX_KEYWORD_PATTERNS];
+    const char* for_keyword[] = {"for"};
+    const char* while_keyword[] = {"while"};
+    const char* open_brace[] = {"{"};
+    const char* open_paren[] = {"("};
+    const char* semicolon[] = {";"};
+    int count = 0;
+
+    semicolon_required_mask = add_keywords(patterns, &count, semicolon_required_keywords, KEYWORD_COUNT(semicolon_required_keywords));
+    semicolon_excluded_mask = add_keywords(patterns, &count, semicolon_excluded_keywords, KEYWORD_COUNT(semicolon_excluded_keywords));
+    declaration_mask = add_keywords(patterns, &count, declaration_keywords, KEYWORD_COUNT(declaration_keywords));
+    for_bit = add_keywords(patterns, &count, for_keyword, 1);
+    while_bit = add_keywords(patterns, &count, while_keyword, 1);
+    open_brace_bit = add_keywords(patterns, &count, open_brace, 1);
+    open_paren_bit = add_keywords(patterns, &count, open_paren, 1);
+    semicolon_bit = add_keywords(patterns, &count, semicolon, 1);
+
+    semicolon_matcher = createKeywordMatcher(patterns, count);
+}
+
+void init_semicolon_matcher() {
+    pthread_once(&semicolon_matcher_once, build_semicolon_matcher);
+}
+
+// Semicolon checks over the tokens of one line. Returns 1 if the line was reported
+// for not ending with a semicolon, which is always the line's first finding.
+int check_semicolons(const LexLine* line, int in_struct_definition, TokenList* tokenList) {
+    int line_num = line->number;
+    int should_have_semicolon = 0;
+    uint64_t found = matchKeywords(semicolon_matcher, line);
+
+    //Check if the line should end with a semicolon
+    if(found & semicolon_required_mask){
+
+        //exclude lines that shouldnt end with a semicolon
+        if((found & semicolon_excluded_mask) ||
+        ((found & for_bit) && (found & open_paren_bit)) || ((found & while_bit) && (found & open_paren_bit))) { // More specific for loops/whiles
+         should_have_semicolon = 0;
+     } else {
+         should_have_semicolon = 1; // Semicolon needed
+     }
+    }
+
+    //check for variable and function declaration
+    if((found & declaration_mask) && !(found & open_brace_bit)) {
+        should_have_semicolon = 1;
+    }
+
+    //check if the line is ending with a semicolon
+    int missing_at_end = 0;
+    if(should_have_semicolon && !in_struct_definition && !isPunct(line->text, &line->tokens[line->count - 1], ';')){
+        char description[100];
+        sprintf(description, "Missing semicolon at the end of line %d", line_num);
+        AddToken(tokenList, "Missing Semicolon", line_num, description);
+        missing_at_end = 1;
+    }
+
+    //check for missing semicolons in for loop
+    if((found & for_bit) && !(found & semicolon_bit)){
+        char description[100];
+        sprintf(description, "Missing semicolon in for loop at line %d", line_num);
+        AddToken(tokenList, "Missing Semicolon", line_num, description);
+    }
+
+    //check for extra semicolons
+    int consecutive_semicolons = 0;
+    for(int i = 0; i < line->count; i++) {
+        if(isPunct(line->text, &line->tokens[i], ';')) {
+            consecutive_semicolons++;
+            if(consecutive_semicolons > 1) {
                 char description[100];
-                sprintf(description, "Missing arguments for strcpy or strcat at line %d", line_num);
-                AddToken(tokenList, "Missing Arguments", line_num, description);
+                sprintf(description, "Extra semicolon at line %d", line_num);
+                AddToken(tokenList, "Extra Semicolon", line_num, description);
+                consecutive_semicolons = 0;
             }
-          }
+        } else {
+            consecutive_semicolons = 0;
         }
+    }
+    return missing_at_end;
+}
 
-        // // Check for null pointer dereference
-        // if (strstr(line, "->" ) != NULL || strstr(line, "*") != NULL) {
-        //     if (strstr(line, "NULL") == NULL && strstr(line, "!= NULL") == NULL) {
-        //         char description[100];
-        //         sprintf(description, "Possible null pointer dereference at line %d", line_num);
-        //         AddToken(tokenList, "Null Pointer", line_num, description);
-        //     }
-        // }
-
-        // check for free block without arguments
-        if(strstr(line, "free") != NULL && (strstr(line, "(") == NULL || strstr(line, ")") == NULL)){
-            char description[100];
-            sprintf(description, "No reference for free at line %d", line_num);
-            AddToken(tokenList, "free error", line_num, description);
+// Whether a number token is zero: 0, 0.0, 0x0, 0L, ...
+int is_zero_literal(const char* text, const LexToken* token) {
+    const char* p = text + token->offset;
+    const char* end = p + token->length;
+    if(end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+    }
+    int digits = 0;
+    for(; p < end && (isdigit((unsigned char)*p) || *p == '.'); p++) {
+        if(*p != '0' && *p != '.') {
+            return 0;
         }
-        if(strstr(line, "malloc")!= NULL && (strstr(line, "(") == NULL || strstr(line, ")") == NULL)){
+        digits += *p == '0';
+    }
+    // What is left can only be a suffix (u, l, f) or an exponent of a zero
+    return digits > 0;
+}
+
+void check_division_by_zero(const LexLine* line, TokenList* tokenList) {
+    for(int i = 0; i + 1 < line->count; i++) {
+        const LexToken* token = &line->tokens[i];
+        int divides = isPunct(line->text, token, '/') || isPunct(line->text, token, '%') ||
+                      tokenEquals(line->text, token, "/=") || tokenEquals(line->text, token, "%=");
+        if(divides && line->tokens[i + 1].kind == LEX_NUMBER && is_zero_literal(line->text, &line->tokens[i + 1])) {
             char description[100];
-            sprintf(description, "No reference for malloc at line %d", line_num);
-            AddToken(tokenList, "malloc error", line_num, description);
+            sprintf(description, "Division by zero at line %d", line->number);
+            AddToken(tokenList, "Division by Zero", line->number, description);
+            return;
         }
-        if(strstr(line, "calloc")!= NULL && (strstr(line, "(") == NULL || strstr(line, ")") == NULL)){
-            char description[100];
-            sprintf(description, "No reference for calloc at line %d", line_num);
-            AddToken(tokenList, "calloc error", line_num, description);
+    }
+}
+
+void check_unsafe_calls(const LexLine* line, TokenList* tokenList) {
+    int line_num = line->number;
+    // Calls of interest on this line, and whether each one had no argument list
+    int gets = 0, unsafe_string = 0, unsafe_string_no_args = 0;
+    int no_args_free = 0, no_args_malloc = 0, no_args_calloc = 0, no_args_realloc = 0, no_args_exit = 0;
+    for(int i = 0; i < line->count; i++) {
+        const LexToken* token = &line->tokens[i];
+        if(token->kind != LEX_IDENTIFIER) {
+            continue;
         }
-        if(strstr(line, "realloc")!= NULL && (strstr(line, "(") == NULL || strstr(line, ")") == NULL)){
-            char description[100];
-            sprintf(description, "No reference for realloc at line %d", line_num);
-            AddToken(tokenList, "realloc error", line_num, description);
+        int called = i + 1 < line->count && isPunct(line->text, &line->tokens[i + 1], '(');
+        if(tokenEquals(line->text, token, "gets")) {
+            gets = 1;
+        } else if(tokenEquals(line->text, token, "strcpy") || tokenEquals(line->text, token, "strcat") || tokenEquals(line->text, token, "strcmp")) {
+            unsafe_string = 1;
+            unsafe_string_no_args |= !called;
+        } else if(tokenEquals(line->text, token, "free")) {
+            no_args_free |= !called;
+        } else if(tokenEquals(line->text, token, "malloc")) {
+            no_args_malloc |= !called;
+        } else if(tokenEquals(line->text, token, "calloc")) {
+            no_args_calloc |= !called;
+        } else if(tokenEquals(line->text, token, "realloc")) {
+            no_args_realloc |= !called;
+        } else if(tokenEquals(line->text, token, "exit")) {
+            no_args_exit |= !called;
         }
-        if(strstr(line, "exit")!= NULL && (strstr(line, "(") == NULL || strstr(line, ")") == NULL)){
-            char description[100];
-            sprintf(description, "No reference for exit at line %d", line_num);
-            AddToken(tokenList, "exit error", line_num, description);
+    }
+
+    //unsafe gets
+    if(gets){
+        char description[100];
+        sprintf(description, "Unsafe option of using gets Instead use fgets at line: %d", line_num);
+        AddToken(tokenList, "unsafe option", line_num, description);
+    }
+
+    if (unsafe_string) {
+        char description[100];
+        sprintf(description, "Buffer overflow: Unsafe String operation without bounds checking");
+        AddToken(tokenList, "Buffer Overflow", line_num, description);
+        if(unsafe_string_no_args) {
+            sprintf(description, "Missing arguments for strcpy or strcat at line %d", line_num);
+            AddToken(tokenList, "Missing Arguments", line_num, description);
         }
+    }
+
+    // check for free block without arguments
+    if(no_args_free){
+        char description[100];
+        sprintf(description, "No reference for free at line %d", line_num);
+        AddToken(tokenList, "free error", line_num, description);
+    }
+    if(no_args_malloc){
+        char description[100];
+        sprintf(description, "No reference for malloc at line %d", line_num);
+        AddToken(tokenList, "malloc error", line_num, description);
+    }
+    if(no_args_calloc){
+        char description[100];
+        sprintf(description, "No reference for calloc at line %d", line_num);
+        AddToken(tokenList, "calloc error", line_num, description);
+    }
+    if(no_args_realloc){
+        char description[100];
+        sprintf(description, "No reference for realloc at line %d", line_num);
+        AddToken(tokenList, "realloc error", line_num, description);
+    }
+    if(no_args_exit){
+        char description[100];
+        sprintf(description, "No reference for exit at line %d", line_num);
+        AddToken(tokenList, "exit error", line_num, description);
+    }
+}
 
-        line_num++;
+// Variables seen by the uninitialized check, found through the table's index
+// one identifier of the line at a time. Lines are not searched at all while
+// every variable is initialized.
+typedef struct UninitializedState {
+    VariableTable* variables;
+    int uninitialized;           // Variables not initialized yet
+} UninitializedState;
+
+void set_initialized(UninitializedState* state, VariableInfo* var, int initialized) {
+    state->uninitialized += (var->is_initialized == 0) - (initialized == 0);
+    var->is_initialized = initialized;
+}
+
+void report_uninitialized(VariableInfo* var, int line_num, TokenList* tokenList) {
+    char description[100];
+    sprintf(description, "Variable '%s' used before initialization at line %d", var->name, line_num);
+    AddToken(tokenList, "Uninitialized Variable", line_num, description);
+}
 
+int is_assignment_operator(const char* text, const LexToken* token) {
+    if(token->kind != LEX_PUNCT) {
+        return 0;
     }
-    fseek(file, 0, SEEK_SET);
-    line_num = 1;
-    VariableInfo* tracked_variables = NULL; // List to track variables in scope
+    const char* op = text + token->offset;
+    return (token->length == 1 && op[0] == '=') ||
+           (token->length == 2 && op[1] == '=' && strchr("+-*/%&|^", op[0]) != NULL) ||
+           (token->length == 3 && op[2] == '=');
+}
+
+// Whether token i of the line is a member name, after '.' or "->".
+int is_member_access(const LexLine* line, int i) {
+    return i > 0 && (isPunct(line->text, &line->tokens[i - 1], '.') || tokenEquals(line->text, &line->tokens[i - 1], "->"));
+}
 
-    while(fgets(line, sizeof(line), file) != NULL){
-        // Skip comments and preprocessor directives for simpler analysis
-        if(line[0] == '\n' || (line[0] == '/' && line[1] == '/') || (line[0] == '/' && line[1] == '*') || (line[0] == '*' && line[1] == '/')){
-            line_num++;
+// Marks the variables whose address the line passes to a parameter a function
+// from its headers may write through, as in "read_config(path, &config);", as
+// initialized by the call.
+void mark_out_arguments(UninitializedState* state, const LexLine* line) {
+    for (int i = 0; i + 1 < line->count; i++) {
+        const LexToken* token = &line->tokens[i];
+        if (token->kind != LEX_IDENTIFIER || !isPunct(line->text, &line->tokens[i + 1], '(')) {
             continue;
         }
-        if(line[0] == '#'){
-            line_num++;
+        const Declaration* declaration = findDeclaration(line->declarations, line->text + token->offset, token->length);
+        if (declaration == NULL || declaration->outParameters == 0) {
             continue;
         }
+        int parameter = 0, depth = 0;
+        for (int j = i + 1; j < line->count; j++) {
+            const LexToken* arg = &line->tokens[j];
+            if (isPunct(line->text, arg, '(')) {
+                depth++;
+            } else if (isPunct(line->text, arg, ')')) {
+                if (--depth == 0) {
+                    break;
+                }
+            } else if (depth == 1 && isPunct(line->text, arg, ',')) {
+                parameter++;
+            } else if (depth == 1 && parameter < 32 && (declaration->outParameters >> parameter & 1) &&
+                       isPunct(line->text, arg, '&') && j + 2 < line->count &&
+                       line->tokens[j + 1].kind == LEX_IDENTIFIER && line->tokens[j + 1].length < 50 &&
+                       (isPunct(line->text, &line->tokens[j - 1], '(') || isPunct(line->text, &line->tokens[j - 1], ',')) &&
+                       (isPunct(line->text, &line->tokens[j + 2], ',') || isPunct(line->text, &line->tokens[j + 2], ')'))) {
+                // The whole argument is "&name"
+                VariableInfo* var = findVariableLength(state->variables, line->text + line->tokens[j + 1].offset,
+                                                       line->tokens[j + 1].length);
+                if (var != NULL && var->is_initialized == 0) {
+                    set_initialized(state, var, 1);
+                }
+            }
+        }
+    }
+}
 
-        // Trim trailing whitespace from the line
-        int len = strlen(line);
-        while(len > 0 && (isspace(line[len - 1]) || line[len - 1] == '\t')){
-            line[len - 1] = '\0';
-            len--;
+// Uninitialized variable check over the tokens of one line.
+void check_uninitialized(UninitializedState* state, const LexLine* line, TokenList* tokenList) {
+    VariableTable* tracked_variables = state->variables;
+    int line_num = line->number;
+    // 1. Detect Variable Declarations and add to tracked_variables
+    char var_name[50], var_type[20];
+    int initialized;
+    int is_declaration = parseDeclaration(line, var_name, var_type, &initialized);
+    if (is_declaration) {
+        // If the variable is already tracked (e.g., re-declaration in a new scope), update its info.
+        VariableInfo* existing_var = findVariable(tracked_variables, var_name);
+        if (existing_var == NULL) {
+            addVariable(tracked_variables, var_name, var_type, line_num, initialized);
+            state->uninitialized += initialized == 0;
+        } else {
+            // Update the latest declaration line and initialization status
+            existing_var->declaration_line = line_num;
+            set_initialized(state, existing_var, initialized);
         }
-        if(len == 0){ // Skip empty lines after trimming
-            line_num++;
+    }
+
+    // 2. Detect Assignments and mark variables as initialized: `variable_name = value;`
+    int assigns = 0;
+    for (int i = 0; i < line->count; i++) {
+        if (!is_assignment_operator(line->text, &line->tokens[i])) {
             continue;
         }
-        // 1. Detect Variable Declarations and add to tracked_variables
-        if (isVariableDeclaration(line)) {
-            char* var_name = extractVariableFromDeclaration(line);
-            char* var_type = extractVariableType(line);
-            int initialized = isInitialized(line);
-
-            if (var_name != NULL && var_type != NULL) {
-                // If the variable is already tracked (e.g., re-declaration in a new scope), update its info.
-                VariableInfo* existing_var = findVariable(tracked_variables, var_name);
-                if (existing_var == NULL) {
-                     addVariable(&tracked_variables, var_name, var_type, line_num, initialized);
-                } else {
-                    // Update the latest declaration line and initialization status
-                    existing_var->declaration_line = line_num;
-                    existing_var->is_initialized = initialized;
-                }
+        assigns = 1;
+        if (isPunct(line->text, &line->tokens[i], '=') && i > 0 && line->tokens[i - 1].kind == LEX_IDENTIFIER &&
+            !is_member_access(line, i - 1) && line->tokens[i - 1].length < 50) {
+            VariableInfo* var = findVariableLength(tracked_variables, line->text + line->tokens[i - 1].offset, line->tokens[i - 1].length);
+            if (var != NULL && var->is_initialized == 0) {
+                set_initialized(state, var, 1); // Mark the variable as initialized upon assignment
             }
         }
+    }
+
+    if (line->declarations != NULL && state->uninitialized > 0) {
+        mark_out_arguments(state, line);
+    }
+
+    // 3. Detect Variable Usage and Check for Uninitialization
+    // Declarations and assignments are never reported, and with every variable
+    // initialized there is nothing to find.
+    if (is_declaration || assigns || state->uninitialized == 0) {
+        return;
+    }
+
+    LineCandidates candidates;
+    beginLineCandidates(&candidates, line_num);
+    for (int i = 0; i < line->count; i++) {
+        const LexToken* token = &line->tokens[i];
+        if (token->kind != LEX_IDENTIFIER || token->length >= 50 || is_member_access(line, i)) {
+            continue;
+        }
+        VariableInfo* var = findVariableLength(tracked_variables, line->text + token->offset, token->length);
+        if (var != NULL && var->is_initialized == 0 && var->declaration_line <= line_num) {
+            addLineCandidate(&candidates, var);
+        }
+    }
 
-        // 2. Detect Assignments and mark variables as initialized
-        // This is a simplified check for assignments like `variable_name = value;`
-        char *equals_pos = strchr(line, '=');
-        if (equals_pos != NULL) {
-            // Attempt to extract the variable name on the left-hand side of '='
-            char *name_end_ptr = equals_pos - 1;
-            while (name_end_ptr >= line && isspace(*name_end_ptr)) {
-                name_end_ptr--;
+    if (!sortLineCandidates(&candidates)) {
+        for (VariableInfo* var = tracked_variables->head; var != NULL; var = var->next) {
+            if (var->seen_line == line_num) {
+                report_uninitialized(var, line_num, tokenList);
             }
+        }
+        return;
+    }
+    for (int i = 0; i < candidates.count; i++) {
+        report_uninitialized(candidates.items[i], line_num, tokenList);
+    }
+}
+
+// The line checks, in the order the text report lists their findings
+typedef enum LineCheck {
+    CHECK_BRACKETS,
+    CHECK_SEMICOLONS,
+    CHECK_DIVISION,
+    CHECK_UNSAFE_CALLS,
+    CHECK_UNINITIALIZED,
+    LINE_CHECK_COUNT
+} LineCheck;
+
+// What the line checks carry from one line to the next, and their findings. Each
+// check keeps its own findings list so the combined report stays grouped by check.
+// The uninitialized check tracks each function in its own scope, dropped when the
+// function ends, and code outside functions in one file scope.
+typedef struct LineChecks {
+    BracketState brackets;
+    int in_struct_definition;    // -1 while a chunk hasn't seen a line that decides it
+    FunctionScopes scopes;
+    UninitializedState file_scope;
+    UninitializedState function_scope;
+    UninitializedState* tracked_variables; // Variables in scope
+    ScopeFilter uninitialized_scopes;      // Lines the uninitialized check runs on
+    int other_checks;            // Whether the other checks run
+    TokenList findings[LINE_CHECK_COUNT];
+    // A chunk's missing-semicolon findings from before in_struct_definition was
+    // known; dropped if the chunk turns out to start inside a struct
+    token** gated;
+    int gated_count;
+    int gated_capacity;
+} LineChecks;
+
+void begin_line_checks(LineChecks* checks, FunctionInfo* functions, FindingWriter* writer) {
+    memset(checks, 0, sizeof(LineChecks));
+    checks->brackets.top = -1;
+    beginFunctionScopes(&checks->scopes, functions);
+    checks->file_scope.variables = createVariableTable();
+    checks->tracked_variables = &checks->file_scope;
+    checks->uninitialized_scopes = SCOPES_ALL;
+    checks->other_checks = 1;
+    for(int c = 0; c < LINE_CHECK_COUNT; c++) {
+        checks->findings[c].writer = writer;
+    }
+    init_semicolon_matcher();
+}
 
-            char *name_start_ptr = name_end_ptr;
-            while (name_start_ptr >= line && (isalnum(*name_start_ptr) || *name_start_ptr == '_')) {
-                name_start_ptr--;
+// Runs the checks over lines from .. to - 1 (counting from 0).
+void run_line_checks(LineChecks* checks, const LexedSource* lexed, int from, int to) {
+    for(int index = from; index < to; index++){
+        LexLine line;
+        getLexLine(lexed, index, &line);
+        if(enterFunctionScope(&checks->scopes, line.number)) {
+            if(checks->tracked_variables == &checks->function_scope) {
+                freeVariableTable(checks->function_scope.variables);
             }
-            name_start_ptr++; // Move to the actual start of the variable name
-
-            if (name_start_ptr < equals_pos) { // Ensure a variable name was found before '='
-                char var_name_assigned[50];
-                int name_len = name_end_ptr - name_start_ptr + 1;
-                if (name_len > 0 && name_len < 50) {
-                    strncpy(var_name_assigned, name_start_ptr, name_len);
-                    var_name_assigned[name_len] = '\0';
-
-                    VariableInfo* var = findVariable(tracked_variables, var_name_assigned);
-                    if (var != NULL) {
-                        var->is_initialized = 1; // Mark the variable as initialized upon assignment
-                    }
-                }
+            if(checks->scopes.end_line != 0) {
+                UninitializedState fresh = {createVariableTable(), 0};
+                checks->function_scope = fresh;
+                checks->tracked_variables = &checks->function_scope;
+            } else {
+                checks->tracked_variables = &checks->file_scope;
             }
         }
-        
-        // 3. Detect Variable Usage and Check for Uninitialization
-        VariableInfo* current_var = tracked_variables;
-        while (current_var != NULL) {
-            // Check only if the variable has been declared at or before the current line
-            // and if it's currently marked as uninitialized.
-            if (current_var->declaration_line <= line_num && current_var->is_initialized == 0) {
-                // Look for the variable's name in the current line
-                char* found_usage = strstr(line, current_var->name);
-
-                if (found_usage != NULL) {
-                    // Apply a basic word boundary check to reduce false positives
-                    // (e.g., "my_var" should not trigger if "another_my_variable" is found)
-                    int is_whole_word = 1;
-                    if (found_usage > line && (isalnum(*(found_usage - 1)) || *(found_usage - 1) == '_')) {
-                        is_whole_word = 0;
-                    }
-                    if (*(found_usage + strlen(current_var->name)) != '\0' && (isalnum(*(found_usage + strlen(current_var->name))) || *(found_usage + strlen(current_var->name)) == '_')) {
-                        is_whole_word = 0;
-                    }
 
-                    // Exclude lines that are themselves declarations or assignments to this variable
-                    if (is_whole_word && !isVariableDeclaration(line) && strchr(line, '=') == NULL) {
-                        char description[100];
-                        sprintf(description, "Variable '%s' used before initialization at line %d", current_var->name, line_num);
-                        AddToken(tokenList, "Uninitialized Variable", line_num, description);
+        // Blank lines, comments and preprocessor directives have nothing to check
+        if(line.count == 0 || line.tokens[0].kind == LEX_DIRECTIVE){
+            continue;
+        }
+
+        if(checks->other_checks) {
+            StatsMark mark = statsEnter(STAGE_BRACKETS);
+            check_brackets(&checks->brackets, &line, &checks->findings[CHECK_BRACKETS]);
+            statsLeave(mark, 1);
+            mark = statsEnter(STAGE_DIVISION);
+            check_division_by_zero(&line, &checks->findings[CHECK_DIVISION]);
+            statsLeave(mark, 1);
+            mark = statsEnter(STAGE_UNSAFE_CALLS);
+            check_unsafe_calls(&line, &checks->findings[CHECK_UNSAFE_CALLS]);
+            statsLeave(mark, 1);
+
+            // Check if entering or exiting a struct definition
+            int has_struct = 0, has_open_brace = 0, has_close_brace = 0;
+            for(int i = 0; i < line.count; i++) {
+                has_struct |= tokenEquals(line.text, &line.tokens[i], "struct");
+                has_open_brace |= isPunct(line.text, &line.tokens[i], '{');
+                has_close_brace |= isPunct(line.text, &line.tokens[i], '}');
+            }
+            if(has_struct && has_open_brace) {
+                checks->in_struct_definition = 1;
+            }
+            if(has_close_brace && checks->in_struct_definition) {
+                checks->in_struct_definition = 0;
+            }
+
+            mark = statsEnter(STAGE_SEMICOLONS);
+            TokenList* semicolons = &checks->findings[CHECK_SEMICOLONS];
+            token* before = semicolons->tail;
+            if(check_semicolons(&line, checks->in_struct_definition == 1, semicolons) && checks->in_struct_definition == -1) {
+                if(checks->gated_count == checks->gated_capacity) {
+                    checks->gated_capacity = checks->gated_capacity ? checks->gated_capacity * 2 : 16;
+                    checks->gated = (token**)realloc(checks->gated, sizeof(token*) * checks->gated_capacity);
+                    if(checks->gated == NULL) {
+                        printf("Memory allocation failed!\n");
+                        exit(1);
                     }
                 }
+                checks->gated[checks->gated_count++] = before != NULL ? before->next : semicolons->head;
             }
-            current_var = current_var->next;
+            statsLeave(mark, 1);
+        }
+
+        if(scopeSelected(&checks->scopes, checks->uninitialized_scopes)) {
+            StatsMark mark = statsEnter(STAGE_UNINITIALIZED);
+            check_uninitialized(checks->tracked_variables, &line, &checks->findings[CHECK_UNINITIALIZED]);
+            statsLeave(mark, 1);
         }
-        line_num++;
     }
-    fclose(file);
 }
 
-void report_variables(){
-    VariableInfo* Variables = NULL;
-    Variables = extractAllVariables("testcase.txt");
-    printf("Extracting variables from testcase.txt...\n");
-    if (Variables == NULL) {
-        printf("Debug: extractAllVariables returned NULL\n");
+// Frees what the checks carry between lines; their findings stay.
+void end_line_checks(LineChecks* checks) {
+    free(checks->brackets.stack);
+    free(checks->brackets.bracket_positions);
+    free(checks->brackets.pending);
+    if(checks->tracked_variables == &checks->function_scope) {
+        freeVariableTable(checks->function_scope.variables);
+    }
+    freeVariableTable(checks->file_scope.variables);
+    free(checks->gated);
+}
+
+// Runs every line-level detector over the tokens of a lexed source, adding their
+// findings to tokenList in the order the checks have always been reported in.
+void analyse_tokens(const LexedSource* lexed, FunctionInfo* functions, TokenList* tokenList) {
+    LineChecks checks;
+    begin_line_checks(&checks, functions, tokenList->writer);
+    run_line_checks(&checks, lexed, 0, lexed->line_count);
+
+    StatsMark mark = statsEnter(STAGE_BRACKETS);
+    check_unclosed_brackets(&checks.brackets, &checks.findings[CHECK_BRACKETS]);
+    statsLeave(mark, 0);
+    end_line_checks(&checks);
+
+    for(int c = 0; c < LINE_CHECK_COUNT; c++) {
+        AppendTokens(tokenList, &checks.findings[c]);
+    }
+}
+
+void analyse_code(const char* code, TokenList* tokenList, FILE* out) {
+    LexedSource lexed;
+    if(!openLexedFile(code, &lexed)){
+        fprintf(out, "Error opening file. Please check the file name and try again.\n %s\n", code);
+        return;
+    }
+    FunctionInfo* functions = extractFunctionsFromTokens(&lexed);
+    analyse_tokens(&lexed, functions, tokenList);
+    freeFunctionList(functions);
+    closeLexedSource(&lexed);
+}
+
+void report_variables(const char* filename, VariableTable* Variables, FILE* out){
+    fprintf(out, "Extracting variables from %s...\n", filename);
+    if (Variables == NULL || Variables->head == NULL) {
+        fprintf(out, "Debug: extractAllVariables returned NULL\n");
     }
-    displayVariables(Variables);
-    freeVariableList(Variables); // Free the allocated variable list
+    displayVariables(Variables, out);
 }
 
-void report_functions(){
-    FunctionInfo* Funcs = NULL;
-    Funcs = extractAllFunctions("testcase.txt");
-    printf("Extracting functions from testcase.txt...\n");
+void report_functions(const char* filename, FunctionInfo* Funcs, FILE* out){
+    fprintf(out, "Extracting functions from %s...\n", filename);
     if (Funcs == NULL) {
-        printf("Debug: extractAllFunctions returned NULL\n");
+        fprintf(out, "Debug: extractAllFunctions returned NULL\n");
     }
-    displayFunctions(Funcs);
-    freeFunctionList(Funcs); // Free the allocated function list
+    displayFunctions(Funcs, out);
 }
 
-int main() {
-    token* tokenList = NULL;
+// The passes analyse_file makes over a lexed file. Each only reads the tokens and
+// the function list, so they can run side by side, one task each.
+typedef enum Detector {
+    DETECTOR_LINES,          // Brackets, semicolons, division, unsafe calls, uninitialized
+    DETECTOR_VARIABLES,      // Symbol table, use-after-free and double frees
+    DETECTOR_CALL_GRAPH,
+    DETECTOR_COUNT
+} Detector;
 
-    printf("====Bug-Detection in C using C====\n");
-    analyse_code("testcase.txt", &tokenList);
-    
-    ShowTokens(tokenList);
-    delete_tokens(tokenList);
-    
-    printf("Report for Variables and Functions in testcase.txt\n\n");
-    report_variables();
-    report_functions();
-    
-    printf("Infinite Recurssions found: \n\n");
-    detectInfiniteRecursion("testcase.txt");
+typedef struct FileAnalysis {
+    const LexedSource* lexed;
+    FunctionInfo* functions;
+    int keep_symbols;        // The text report lists the variables
+    TokenList lines;
+    FindingWriter* variable_writer;
+    VariableTable* variables;
+    CallGraph* graph;
+    Stats task_stats[DETECTOR_COUNT];
+} FileAnalysis;
 
+// A writer that keeps findings in list, for writing out later
+FindingWriter* record_writer(const char* filename, FindingList* list) {
+    FindingWriter* writer = (FindingWriter*)malloc(sizeof(FindingWriter));
+    if (writer == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    initFindingWriter(writer, NULL, OUTPUT_RECORD, filename);
+    writer->records = list;
+    return writer;
+}
 
-    return 0;
-}
\ No newline at end of file
+void run_detector(FileAnalysis* analysis, int detector) {
+    switch (detector) {
+    case DETECTOR_LINES:
+        analyse_tokens(analysis->lexed, analysis->functions, &analysis->lines);
+        break;
+    case DETECTOR_VARIABLES:
+        analysis->variables = extractVariablesFromTokens(analysis->lexed, analysis->functions,
+                                                         analysis->keep_symbols, analysis->variable_writer);
+        break;
+    case DETECTOR_CALL_GRAPH:
+        analysis->graph = readCallGraph(analysis->lexed);
+        buildCallGraph(analysis->graph);
+        break;
+    }
+}
+
+void run_detector_task(int task, int worker, void* context) {
+    (void)worker;
+    FileAnalysis* analysis = (FileAnalysis*)context;
+    statsAttach(&analysis->task_stats[task]);
+    run_detector(analysis, task);
+    statsDetach();
+}
+
+// ---- Splitting one file ----
+// A long file analysed with jobs > 1 is cut into chunks at the first lines of
+// top-level functions, and each chunk gets every detector on a thread of its own.
+// Code outside functions shares one scope across the whole file, so the
+// uninitialized and variable checks of those lines run as one more task. What
+// crosses a chunk boundary is put back together in chunk order afterwards:
+// closing brackets a chunk had no opening bracket for are matched against the
+// brackets earlier chunks left open, missing-semicolon findings from a chunk's
+// first lines are dropped if those lines turn out to be inside a struct
+// definition, findings are merged by line and the call graphs are merged. The
+// report is the same as the single-threaded one.
+
+int split_min_lines = 20000;     // Shorter files are not worth splitting
+#define CHUNKS_PER_JOB 4         // More chunks than threads, to even out uneven chunks
+
+typedef struct FileChunk {
+    int from, to;                // Lines, counting from 0
+    int token_from, token_to;    // Tokens the call graph scan covers
+    FunctionInfo* functions;     // The chunk's first function
+    LineChecks checks;
+    FindingList variable_findings;
+    VariableTable* variables;
+    CallGraph* graph;
+    Stats stats;
+} FileChunk;
+
+typedef struct SplitFile {
+    FileAnalysis* analysis;
+    FileChunk* chunks;           // chunk_count chunks, then the file-scope task
+    int chunk_count;
+} SplitFile;
+
+void run_chunk_task(int task, int worker, void* context) {
+    (void)worker;
+    SplitFile* split = (SplitFile*)context;
+    FileAnalysis* analysis = split->analysis;
+    FileChunk* chunk = &split->chunks[task];
+    int file_scope = task == split->chunk_count;
+    statsAttach(&chunk->stats);
+
+    begin_line_checks(&chunk->checks, chunk->functions, NULL);
+    if (file_scope) {
+        chunk->checks.other_checks = 0;
+        chunk->checks.uninitialized_scopes = SCOPES_FILE;
+    } else {
+        chunk->checks.brackets.defer = 1;
+        chunk->checks.in_struct_definition = -1;
+        chunk->checks.uninitialized_scopes = SCOPES_FUNCTIONS;
+    }
+    run_line_checks(&chunk->checks, analysis->lexed, chunk->from, chunk->to);
+
+    FindingWriter* writer = record_writer(NULL, &chunk->variable_findings);
+    chunk->variables = extractVariablesInLines(analysis->lexed, chunk->from, chunk->to, chunk->functions,
+                                               file_scope ? SCOPES_FILE : SCOPES_FUNCTIONS,
+                                               analysis->keep_symbols, writer);
+    free(writer);
+    if (!file_scope)
+        chunk->graph = readCallGraphRange(analysis->lexed, chunk->token_from, chunk->token_to);
+    statsDetach();
+}
+
+// Cuts the file into chunks of about equal length, each starting at a function
+// the single-threaded scan enters on its first line. Returns the number of chunks.
+int plan_chunks(SplitFile* split, int jobs) {
+    const LexedSource* lexed = split->analysis->lexed;
+    int target = jobs * CHUNKS_PER_JOB;
+    int chunk_lines = lexed->line_count / target + 1;
+    // One more for the file-scope task
+    split->chunks = (FileChunk*)calloc(target + 1, sizeof(FileChunk));
+    if (split->chunks == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    FileChunk* chunk = &split->chunks[0];
+    chunk->functions = split->analysis->functions;
+    int count = 1;
+    int scope_end = 0;           // Last line of the function the scan is in
+    for (FunctionInfo* f = split->analysis->functions; f != NULL; f = f->next) {
+        if (f->start_line <= scope_end)
+            continue;            // Starts inside another function, or on its first line
+        int from = f->start_line - lexed->first_line;
+        if (from - chunk->from >= chunk_lines && count < target) {
+            chunk->to = from;
+            chunk->token_to = f->scan_token;
+            chunk = &split->chunks[count++];
+            chunk->from = from;
+            chunk->token_from = f->scan_token;
+            chunk->functions = f;
+        }
+        scope_end = f->end_line < f->start_line ? f->start_line : f->end_line;
+    }
+    chunk->to = lexed->line_count;
+    chunk->token_to = lexed->count;
+
+    FileChunk* file_scope = &split->chunks[count];
+    file_scope->from = 0;
+    file_scope->to = lexed->line_count;
+    file_scope->functions = split->analysis->functions;
+    split->chunk_count = count;
+    return count;
+}
+
+// Puts the chunks' results together into the analysis, as if one thread had
+// gone through the file.
+void stitch_chunks(SplitFile* split) {
+    FileAnalysis* analysis = split->analysis;
+    BracketState open = {NULL, -1, 0, NULL, 0, NULL, 0, 0};  // Brackets the chunks so far left open
+    int in_struct_definition = 0;
+    TokenList merged[LINE_CHECK_COUNT];
+    memset(merged, 0, sizeof(merged));
+    VariableInfo* kept_head = NULL;
+    VariableInfo* kept_tail = NULL;
+    analysis->graph = createCallGraph();
+
+    for (int c = 0; c < split->chunk_count; c++) {
+        FileChunk* chunk = &split->chunks[c];
+        LineChecks* checks = &chunk->checks;
+
+        // Closing brackets for brackets opened before the chunk. Several may follow
+        // the same finding, so each goes after the one placed before it.
+        TokenList* brackets = &checks->findings[CHECK_BRACKETS];
+        token* cursor = NULL;
+        for (int i = 0; i < checks->brackets.pending_count; i++) {
+            PendingBracket* pending = &checks->brackets.pending[i];
+            if (i == 0 || pending->after != checks->brackets.pending[i - 1].after)
+                cursor = pending->after;
+            char description[100];
+            if (close_bracket(&open, pending->bracket, description))
+                cursor = InsertTokenAfter(brackets, cursor, "Bracket Error", pending->line_num, description);
+        }
+        for (int i = 0; i <= checks->brackets.top; i++)
+            push_bracket(&open, checks->brackets.stack[i], checks->brackets.bracket_positions[i]);
+
+        if (in_struct_definition == 1)
+            RemoveTokens(&checks->findings[CHECK_SEMICOLONS], checks->gated, checks->gated_count);
+        if (checks->in_struct_definition != -1)
+            in_struct_definition = checks->in_struct_definition;
+
+        for (int check = 0; check < LINE_CHECK_COUNT; check++)
+            AppendTokens(&merged[check], &checks->findings[check]);
+        end_line_checks(checks);
+
+        if (chunk->variables != NULL)
+            closeVariableScope(chunk->variables, 1, &kept_head, &kept_tail);
+        mergeCallGraph(analysis->graph, chunk->graph);
+        freeCallGraph(chunk->graph);
+    }
+    buildCallGraph(analysis->graph);
+
+    // Lines outside functions
+    FileChunk* file_scope = &split->chunks[split->chunk_count];
+    MergeTokensByLine(&merged[CHECK_UNINITIALIZED], &file_scope->checks.findings[CHECK_UNINITIALIZED]);
+    end_line_checks(&file_scope->checks);
+    analysis->variables = file_scope->variables;
+    if (analysis->variables != NULL)
+        rebuildVariableTable(analysis->variables, mergeVariablesByLine(analysis->variables->head, kept_head));
+
+    TokenList unclosed = {NULL, NULL, NULL, NULL};
+    check_unclosed_brackets(&open, &unclosed);
+    free(open.stack);
+    free(open.bracket_positions);
+
+    if (analysis->lines.writer == NULL) {
+        // Grouped by check, as the text report lists them
+        AppendTokens(&merged[CHECK_BRACKETS], &unclosed);
+        for (int check = 0; check < LINE_CHECK_COUNT; check++)
+            AppendTokens(&analysis->lines, &merged[check]);
+    } else {
+        // In the order they are found going line by line, each line's checks in the
+        // order run_line_checks runs them
+        static const LineCheck run_order[LINE_CHECK_COUNT] = {
+            CHECK_BRACKETS, CHECK_DIVISION, CHECK_UNSAFE_CALLS, CHECK_SEMICOLONS, CHECK_UNINITIALIZED
+        };
+        token* next[LINE_CHECK_COUNT];
+        for (int check = 0; check < LINE_CHECK_COUNT; check++)
+            next[check] = merged[check].head;
+        for (;;) {
+            int first = -1;
+            for (int i = 0; i < LINE_CHECK_COUNT; i++) {
+                int check = run_order[i];
+                if (next[check] != NULL && (first == -1 || next[check]->line_num < next[first]->line_num))
+                    first = check;
+            }
+            if (first == -1)
+                break;
+            AddToken(&analysis->lines, next[first]->type, next[first]->line_num, next[first]->description);
+            next[first] = next[first]->next;
+        }
+        for (token* current = unclosed.head; current != NULL; current = current->next)
+            AddToken(&analysis->lines, current->type, current->line_num, current->description);
+        for (int check = 0; check < LINE_CHECK_COUNT; check++)
+            delete_tokens(&merged[check]);
+        delete_tokens(&unclosed);
+    }
+
+    // Variable findings, the file-scope lines' in between the chunks'
+    FindingList* outside = &file_scope->variable_findings;
+    int j = 0;
+    for (int c = 0; c < split->chunk_count; c++) {
+        FindingList* findings = &split->chunks[c].variable_findings;
+        for (int i = 0; i < findings->count; i++) {
+            Finding* finding = &findings->items[i];
+            for (; j < outside->count && outside->items[j].line < finding->line; j++)
+                writeFinding(analysis->variable_writer, outside->items[j].severity, outside->items[j].rule,
+                             outside->items[j].line, outside->items[j].message);
+            writeFinding(analysis->variable_writer, finding->severity, finding->rule, finding->line, finding->message);
+        }
+        freeFindingList(findings);
+    }
+    for (; j < outside->count; j++)
+        writeFinding(analysis->variable_writer, outside->items[j].severity, outside->items[j].rule,
+                     outside->items[j].line, outside->items[j].message);
+    freeFindingList(outside);
+
+    if (currentStats != NULL) {
+        for (int c = 0; c <= split->chunk_count; c++)
+            statsAdd(currentStats, &split->chunks[c].stats);
+    }
+}
+
+// Analyses the file chunk by chunk on jobs threads. Returns 0, having done
+// nothing, if it has too few functions to split.
+int analyse_split(FileAnalysis* analysis, int jobs) {
+    SplitFile split;
+    split.analysis = analysis;
+    if (plan_chunks(&split, jobs) < 2) {
+        free(split.chunks);
+        return 0;
+    }
+    TaskPool* pool = startTaskPool(split.chunk_count + 1, jobs, run_chunk_task, &split);
+    finishTaskPool(pool);
+    stitch_chunks(&split);
+    free(split.chunks);
+    return 1;
+}
+
+// Full report for one lexed file: code findings, variables, functions and
+// recursion. In the machine formats only the findings are written. The file is
+// lexed once into a buffer nothing writes to, and with jobs > 1 the detectors
+// run over it at the same time, so a file takes about as long as its slowest
+// detector. Findings are held back until every detector is done, then written
+// in the order the detectors have always run in; a single-threaded machine
+// report streams them as they are found instead. All state is local to the
+// call, so several files can be analysed at once.
+void analyse_lexed(const LexedSource* lexed, const char* filename, FindingWriter* writer, int jobs) {
+    FileAnalysis analysis;
+    analysis.lexed = lexed;
+    analysis.functions = extractFunctionsFromTokens(lexed);
+    analysis.keep_symbols = writer->format == OUTPUT_TEXT;
+    analysis.variables = NULL;
+    analysis.graph = NULL;
+
+    // The text report puts findings between other output, so it always holds them
+    // back; the text line findings are kept as tokens for ShowTokens. Held machine
+    // findings are recorded in the order they would have streamed out. A long file
+    // is split into chunks; otherwise each detector is a task of its own.
+    int hold = jobs > 1 || writer->format == OUTPUT_TEXT;
+    FindingList line_findings = {NULL, 0, 0};
+    FindingList variable_findings = {NULL, 0, 0};
+    FindingWriter* line_writer = writer;
+    analysis.variable_writer = writer;
+    if (hold) {
+        line_writer = writer->format == OUTPUT_TEXT ? NULL : record_writer(filename, &line_findings);
+        analysis.variable_writer = record_writer(filename, &variable_findings);
+    }
+    TokenList lines = {NULL, NULL, NULL, line_writer};
+    analysis.lines = lines;
+
+    init_semicolon_matcher();
+    if (jobs > 1 && lexed->line_count >= split_min_lines && analyse_split(&analysis, jobs)) {
+        // Done chunk by chunk
+    } else if (jobs > 1) {
+        TaskPool* pool = startTaskPool(DETECTOR_COUNT, jobs < DETECTOR_COUNT ? jobs : DETECTOR_COUNT,
+                                       run_detector_task, &analysis);
+        finishTaskPool(pool);
+        if (currentStats != NULL) {
+            for (int d = 0; d < DETECTOR_COUNT; d++)
+                statsAdd(currentStats, &analysis.task_stats[d]);
+        }
+    } else {
+        for (int d = 0; d < DETECTOR_COUNT; d++)
+            run_detector(&analysis, d);
+    }
+
+    if (writer->format != OUTPUT_TEXT) {
+        writeFindings(writer, &line_findings);
+        writeFindings(writer, &variable_findings);
+        reportRecursion(analysis.graph, writer);
+        flushFindingWriter(writer);
+    } else {
+        FILE* out = writer->out;
+        ShowTokens(analysis.lines.head, out);
+
+        fprintf(out, "Report for Variables and Functions in %s\n\n", filename);
+        writeFindings(writer, &variable_findings);
+        report_variables(filename, analysis.variables, out);
+        report_functions(filename, analysis.functions, out);
+
+        fprintf(out, "Infinite Recurssions found: \n\n");
+        reportRecursion(analysis.graph, writer);
+    }
+
+    delete_tokens(&analysis.lines);
+    freeFindingList(&line_findings);
+    freeFindingList(&variable_findings);
+    if (hold) {
+        free(line_writer);
+        free(analysis.variable_writer);
+    }
+    freeVariableTable(analysis.variables);
+    freeCallGraph(analysis.graph);
+    freeFunctionList(analysis.functions);
+}
+
+// Headers the analysed files include, when they are followed (-I, --follow-includes)
+HeaderCache* include_cache = NULL;
+
+// Reads, lexes and analyses filename as above.
+void analyse_file(const char* filename, FindingWriter* writer, int jobs) {
+    LexedSource lexed;
+    if (!openLexedFile(filename, &lexed)) {
+        writeMessage(writer, "Error opening file. Please check the file name and try again.\n %s\n", filename);
+        return;
+    }
+    DeclarationScope scope;
+    if (include_cache != NULL) {
+        openDeclarationScope(include_cache, &lexed, filename, &scope);
+        lexed.declarations = &scope;
+    }
+    analyse_lexed(&lexed, filename, writer, jobs);
+    if (include_cache != NULL)
+        freeDeclarationScope(&scope);
+    closeLexedSource(&lexed);
+}
+
+// ---- Incremental re-analysis ----
+// A file is cut into segments along its FunctionInfo ranges: every function, and the
+// top-level code between functions. Each segment is analysed on its own and keeps
+// its findings, symbols and call sites next to a copy of its text. After an edit,
+// segments whose text is unchanged are reused, just moved to their new lines, and
+// only new or edited segments go through the detectors again, so the cost of an
+// update follows the size of the edit rather than the size of the file. What is
+// still done for the whole file is cheap: hashing, the function scan, and rebuilding
+// the call graph from the cached call sites.
+// Since segments don't share detector state, a result can differ from analyse_file
+// where that state crosses a function boundary (say, a bracket left open); it never
+// depends on which edits led to the current text.
+
+typedef struct Segment {
+    char* text;              // Lines first_line .. first_line + line_count - 1
+    size_t size;
+    unsigned int hash;
+    int first_line;
+    int line_count;
+    FindingList findings;    // In the order the detectors produced them
+    VariableTable* variables;
+    CallGraph* calls;        // Definitions and call sites, not yet built
+} Segment;
+
+typedef struct IncrementalFile {
+    Segment* segments;
+    int segment_count;
+    FunctionInfo* functions;
+    int analysed;            // Segments the last update analysed
+    int reused;              // Segments the last update took from the cache
+} IncrementalFile;
+
+void free_segment(Segment* segment) {
+    free(segment->text);
+    freeFindingList(&segment->findings);
+    freeVariableTable(segment->variables);
+    freeCallGraph(segment->calls);
+}
+
+void free_incremental(IncrementalFile* state) {
+    for (int i = 0; i < state->segment_count; i++)
+        free_segment(&state->segments[i]);
+    free(state->segments);
+    freeFunctionList(state->functions);
+    state->segments = NULL;
+    state->segment_count = 0;
+    state->functions = NULL;
+}
+
+void analyse_segment(Segment* segment) {
+    FindingWriter* writer = (FindingWriter*)malloc(sizeof(FindingWriter));
+    if (writer == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    initFindingWriter(writer, NULL, OUTPUT_RECORD, NULL);
+    writer->records = &segment->findings;
+
+    // One lexed copy serves every pass. A segment is a single scope already:
+    // one function, or code between functions.
+    LexedSource lexed;
+    lexCopy(&lexed, segment->text, segment->size, segment->first_line);
+    TokenList tokenList = {NULL, NULL, NULL, writer};
+    analyse_tokens(&lexed, NULL, &tokenList);
+    segment->variables = extractVariablesFromTokens(&lexed, NULL, 1, writer);
+    segment->calls = readCallGraph(&lexed);
+    closeLexedSource(&lexed);
+    free(writer);
+}
+
+// Adds delta to every line number in message that refers to lines from .. to.
+// Line numbers are the only numbers in findings that stand on their own, not
+// inside an identifier.
+char* shift_message_lines(const char* message, int from, int to, int delta) {
+    size_t capacity = strlen(message) + 1;
+    for (const char* p = message; *p; p++) {
+        if (isdigit((unsigned char)*p))
+            capacity += 11; // Room for a number to grow
+    }
+    char* shifted = (char*)malloc(capacity);
+    if (shifted == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    size_t len = 0;
+    const char* p = message;
+    while (*p) {
+        int standalone = p == message || !(isalnum((unsigned char)p[-1]) || p[-1] == '_');
+        if (!isdigit((unsigned char)*p) || !standalone) {
+            shifted[len++] = *p++;
+            continue;
+        }
+        const char* start = p;
+        long value = 0;
+        while (isdigit((unsigned char)*p)) {
+            if (p - start < 10)
+                value = value * 10 + (*p - '0');
+            p++;
+        }
+        if (p - start < 10 && value >= from && value <= to && !isalpha((unsigned char)*p) && *p != '_') {
+            len += snprintf(shifted + len, capacity - len, "%ld", value + delta);
+        } else {
+            memcpy(shifted + len, start, p - start);
+            len += p - start;
+        }
+    }
+    shifted[len] = '\0';
+    return shifted;
+}
+
+// Renumbers a reused segment's findings, symbols and calls for its new position.
+void move_segment(Segment* segment, int first_line) {
+    int delta = first_line - segment->first_line;
+    if (delta == 0)
+        return;
+    int from = segment->first_line;
+    int to = segment->first_line + segment->line_count - 1;
+    for (int i = 0; i < segment->findings.count; i++) {
+        Finding* finding = &segment->findings.items[i];
+        char* message = shift_message_lines(finding->message, from, to, delta);
+        free(finding->message);
+        finding->message = message;
+        finding->line += delta;
+    }
+    for (VariableInfo* var = segment->variables->head; var != NULL; var = var->next) {
+        var->declaration_line += delta;
+        if (var->freed_line != 0)
+            var->freed_line += delta;
+    }
+    for (int i = 0; i < segment->calls->callCount; i++)
+        segment->calls->calls[i].call_line_number += delta;
+    segment->first_line = first_line;
+}
+
+// Index of the cached segments by text: an open-addressing table (size a power of
+// two) of groups of segments with the same text, each group chained in file order
+// through next_same. Identical segments (the blank lines between functions, say)
+// are handed out in turn in O(1), however many there are.
+typedef struct SegmentIndex {
+    int* slots;              // First segment of each group, -1 when empty
+    int slot_count;
+    int* next_same;          // Next segment with the same text, -1 at the end
+    int* available;          // For a group's first segment: next one not yet taken
+    char* taken;
+} SegmentIndex;
+
+int find_segment_slot(IncrementalFile* state, SegmentIndex* index, const char* text, size_t size, unsigned int hash) {
+    unsigned int mask = index->slot_count - 1;
+    unsigned int i = hash & mask;
+    while (index->slots[i] != -1) {
+        Segment* cached = &state->segments[index->slots[i]];
+        if (cached->hash == hash && cached->size == size && memcmp(cached->text, text, size) == 0)
+            break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void build_segment_index(IncrementalFile* state, SegmentIndex* index) {
+    int count = state->segment_count;
+    index->slot_count = 16;
+    while (index->slot_count < count * 2)
+        index->slot_count *= 2;
+    index->slots = (int*)malloc(sizeof(int) * index->slot_count);
+    index->next_same = (int*)malloc(sizeof(int) * (count + 1));
+    index->available = (int*)malloc(sizeof(int) * (count + 1));
+    index->taken = (char*)calloc(count + 1, 1);
+    int* last = (int*)malloc(sizeof(int) * (count + 1)); // Last segment of each group so far
+    if (index->slots == NULL || index->next_same == NULL || index->available == NULL ||
+        index->taken == NULL || last == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (int i = 0; i < index->slot_count; i++)
+        index->slots[i] = -1;
+    for (int s = 0; s < count; s++) {
+        Segment* segment = &state->segments[s];
+        int slot = find_segment_slot(state, index, segment->text, segment->size, segment->hash);
+        index->next_same[s] = -1;
+        int first = index->slots[slot];
+        if (first == -1) {
+            index->slots[slot] = s;
+            index->available[s] = s;
+            last[s] = s;
+        } else {
+            index->next_same[last[first]] = s;
+            last[first] = s;
+        }
+    }
+    free(last);
+}
+
+void free_segment_index(SegmentIndex* index) {
+    free(index->slots);
+    free(index->next_same);
+    free(index->available);
+    free(index->taken);
+}
+
+// Takes an unused cached segment with exactly this text, -1 if there is none.
+int take_cached_segment(IncrementalFile* state, SegmentIndex* index, const char* text, size_t size, unsigned int hash) {
+    int first = index->slots[find_segment_slot(state, index, text, size, hash)];
+    if (first == -1 || index->available[first] == -1)
+        return -1;
+    int cached = index->available[first];
+    index->available[first] = index->next_same[cached];
+    index->taken[cached] = 1;
+    return cached;
+}
+
+// Brings the analysis of filename up to date with its current contents. Returns 0
+// if the file can't be read, leaving the previous results in place.
+int update_incremental(IncrementalFile* state, const char* filename) {
+    SourceFile source;
+    if (!openSourceFile(filename, &source))
+        return 0;
+
+    // Line starts, for copying segments out whole
+    int line_count = 0, line_capacity = 1024;
+    size_t* line_start = (size_t*)malloc(sizeof(size_t) * (line_capacity + 1));
+    if (line_start == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (size_t offset = 0; offset < source.size; ) {
+        if (line_count == line_capacity) {
+            line_capacity *= 2;
+            line_start = (size_t*)realloc(line_start, sizeof(size_t) * (line_capacity + 1));
+            if (line_start == NULL) {
+                printf("Memory allocation failed!\n");
+                exit(1);
+            }
+        }
+        line_start[line_count++] = offset;
+        const char* end = (const char*)memchr(source.data + offset, '\n', source.size - offset);
+        offset = end == NULL ? source.size : (size_t)(end - source.data) + 1;
+    }
+    line_start[line_count] = source.size;
+
+    // The lexer only reads the buffer, so source stays valid until the lexed copy is closed
+    LexedSource lexed;
+    lexSource(&source, &lexed);
+    FunctionInfo* functions = extractFunctionsFromTokens(&lexed);
+
+    // Segment boundaries: each function, and whatever lies between functions
+    int* bounds = (int*)malloc(sizeof(int) * (2 * line_count + 2));
+    if (bounds == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    int bound_count = 0;
+    int next_line = 1;
+    bounds[bound_count++] = 1;
+    for (FunctionInfo* f = functions; f != NULL; f = f->next) {
+        if (f->start_line < next_line || f->start_line > line_count)
+            continue;
+        int end = f->end_line < f->start_line ? f->start_line : f->end_line;
+        if (end > line_count)
+            end = line_count;
+        if (f->start_line > next_line)
+            bounds[bound_count++] = f->start_line;
+        bounds[bound_count++] = end + 1;
+        next_line = end + 1;
+    }
+    if (next_line <= line_count)
+        bounds[bound_count++] = line_count + 1;
+
+    SegmentIndex index;
+    build_segment_index(state, &index);
+    Segment* segments = (Segment*)calloc(bound_count, sizeof(Segment));
+    if (segments == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+
+    int segment_count = 0;
+    state->analysed = 0;
+    state->reused = 0;
+    for (int b = 0; b + 1 < bound_count; b++) {
+        int first = bounds[b], last = bounds[b + 1] - 1;
+        if (last < first)
+            continue;
+        const char* text = source.data + line_start[first - 1];
+        size_t size = line_start[last] - line_start[first - 1];
+        unsigned int hash = hashNameLength(text, (int)size);
+
+        Segment* segment = &segments[segment_count++];
+        int cached = take_cached_segment(state, &index, text, size, hash);
+        if (cached != -1) {
+            *segment = state->segments[cached];
+            move_segment(segment, first);
+            state->reused++;
+            continue;
+        }
+        segment->text = (char*)malloc(size + 1);
+        if (segment->text == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        memcpy(segment->text, text, size);
+        segment->text[size] = '\0';
+        segment->size = size;
+        segment->hash = hash;
+        segment->first_line = first;
+        segment->line_count = last - first + 1;
+        analyse_segment(segment);
+        state->analysed++;
+    }
+
+    for (int s = 0; s < state->segment_count; s++) {
+        if (!index.taken[s])
+            free_segment(&state->segments[s]);
+    }
+    free(state->segments);
+    freeFunctionList(state->functions);
+    state->segments = segments;
+    state->segment_count = segment_count;
+    state->functions = functions;
+
+    free_segment_index(&index);
+    free(bounds);
+    free(line_start);
+    closeLexedSource(&lexed);
+    return 1;
+}
+
+// Writes the findings of the current analysis, segment by segment, then the
+// recursion found in the call graph put together from every segment's calls.
+void write_incremental(IncrementalFile* state, FindingWriter* writer) {
+    CallGraph* graph = createCallGraph();
+    for (int s = 0; s < state->segment_count; s++) {
+        Segment* segment = &state->segments[s];
+        writeFindings(writer, &segment->findings);
+        mergeCallGraph(graph, segment->calls);
+    }
+    buildCallGraph(graph);
+    reportRecursion(graph, writer);
+    freeCallGraph(graph);
+    flushFindingWriter(writer);
+}
+
+// ---- Batch mode ----
+
+typedef struct SourceList {
+    char** paths;
+    int count;
+    int capacity;
+} SourceList;
+
+void add_source(SourceList* list, const char* path) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->paths = (char**)realloc(list->paths, sizeof(char*) * list->capacity);
+        if (list->paths == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+    }
+    list->paths[list->count] = strdup(path);
+    if (list->paths[list->count] == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    list->count++;
+}
+
+int is_c_source(const char* name) {
+    const char* dot = strrchr(name, '.');
+    return dot != NULL && (strcmp(dot, ".c") == 0 || strcmp(dot, ".h") == 0);
+}
+
+int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Adds a file, or every .c/.h file under a directory in sorted order so the
+// batch report comes out the same on every run.
+void collect_sources(SourceList* list, const char* path) {
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        printf("Error: cannot access %s\n", path);
+        return;
+    }
+    if (!S_ISDIR(info.st_mode)) {
+        add_source(list, path);
+        return;
+    }
+
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        printf("Error: cannot open directory %s\n", path);
+        return;
+    }
+    SourceList entries = {NULL, 0, 0};
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+            add_source(&entries, entry->d_name);
+    }
+    closedir(dir);
+    if (entries.count > 1)
+        qsort(entries.paths, entries.count, sizeof(char*), compare_names);
+
+    for (int i = 0; i < entries.count; i++) {
+        size_t len = strlen(path) + strlen(entries.paths[i]) + 2;
+        char* child = (char*)malloc(len);
+        if (child == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        snprintf(child, len, "%s/%s", path, entries.paths[i]);
+        if (stat(child, &info) == 0 && (S_ISDIR(info.st_mode) || is_c_source(entries.paths[i])))
+            collect_sources(list, child);
+        free(child);
+        free(entries.paths[i]);
+    }
+    free(entries.paths);
+}
+
+// Report for one file in batch mode; text reports get a header naming the file.
+// jobs threads run the file's detectors. written is the number of findings
+// earlier files put on out, so SARIF results are separated across files too;
+// returns it with this file's added.
+int analyse_batch_entry(const char* path, FILE* out, OutputFormat format, int jobs, int written) {
+    FindingWriter* writer = (FindingWriter*)malloc(sizeof(FindingWriter));
+    if (writer == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    initFindingWriter(writer, out, format, path);
+    writer->count = written;
+    if (format == OUTPUT_TEXT)
+        fprintf(out, "\n==== %s ====\n", path);
+    Stats stats;
+    statsBegin(&stats);
+    analyse_file(path, writer, jobs);
+    statsEnd(&stats);
+    written = writer->count;
+    free(writer);
+    return written;
+}
+
+// Each worker writes a file's report to memory; the main thread prints the
+// reports in input order as soon as each one is ready.
+typedef struct FileReport {
+    char* text;
+    size_t size;
+    int done;
+} FileReport;
+
+typedef struct Batch {
+    SourceList* sources;
+    OutputFormat format;
+    FileReport* reports;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+} Batch;
+
+void analyse_batch_file(int task, int worker, void* context) {
+    (void)worker;
+    Batch* batch = (Batch*)context;
+    const char* path = batch->sources->paths[task];
+    char* text = NULL;
+    size_t size = 0;
+#ifdef _WIN32
+    FILE* out = tmpfile();
+#else
+    FILE* out = open_memstream(&text, &size);
+#endif
+    if (out == NULL) {
+        printf("Could not create report buffer.\n");
+        exit(1);
+    }
+
+    analyse_batch_entry(path, out, batch->format, 1, 0);
+
+#ifdef _WIN32
+    size = ftell(out);
+    text = (char*)malloc(size + 1);
+    rewind(out);
+    size = fread(text, 1, size, out);
+#endif
+    fclose(out);
+
+    pthread_mutex_lock(&batch->lock);
+    batch->reports[task].text = text;
+    batch->reports[task].size = size;
+    batch->reports[task].done = 1;
+    pthread_cond_broadcast(&batch->ready);
+    pthread_mutex_unlock(&batch->lock);
+}
+
+int default_jobs() {
+#ifdef _SC_NPROCESSORS_ONLN
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+#else
+    return 1;
+#endif
+}
+
+void analyse_batch(SourceList* sources, int jobs, OutputFormat format) {
+    init_semicolon_matcher(); // Shared read-only by every worker, so build it first
+
+    // With one worker there is nothing to reorder: stream straight to stdout.
+    // A single file gets the workers for its detectors instead.
+    if (jobs == 1 || sources->count == 1) {
+        int written = 0;
+        for (int i = 0; i < sources->count; i++)
+            written = analyse_batch_entry(sources->paths[i], stdout, format, jobs, written);
+        return;
+    }
+
+    Batch batch;
+    batch.sources = sources;
+    batch.format = format;
+    batch.reports = (FileReport*)calloc(sources->count + 1, sizeof(FileReport));
+    if (batch.reports == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.ready, NULL);
+
+    TaskPool* pool = startTaskPool(sources->count, jobs, analyse_batch_file, &batch);
+    int printed = 0;
+    for (int i = 0; i < sources->count; i++) {
+        pthread_mutex_lock(&batch.lock);
+        while (!batch.reports[i].done)
+            pthread_cond_wait(&batch.ready, &batch.lock);
+        pthread_mutex_unlock(&batch.lock);
+
+        if (batch.reports[i].size > 0) {
+            if (format == OUTPUT_SARIF && printed)
+                fputc(',', stdout);
+            fwrite(batch.reports[i].text, 1, batch.reports[i].size, stdout);
+            fflush(stdout);
+            printed = 1;
+        }
+        free(batch.reports[i].text);
+    }
+    finishTaskPool(pool);
+
+    pthread_mutex_destroy(&batch.lock);
+    pthread_cond_destroy(&batch.ready);
+    free(batch.reports);
+}
+
+// ---- Project mode ----
+// test --project compile_commands.json looks for recursion across a whole
+// project: the translation units its compilation database lists are lexed and
+// read in parallel, one task each, and their call graphs put together, in the
+// database's (sorted) order, into one keyed by function name, so a cycle through
+// functions in different files is found too. Cycle detection runs once, over the
+// merged graph. A static function is only visible in its own file: it is keyed
+// as name@file, and only calls from that file resolve to it. The per-file
+// detectors are batch mode's job; headers are not followed.
+// With --index FILE what was read from each unit, and the symbols of its
+// functions, are kept in FILE (see CallIndex.c) for the next run, which only
+// reads the units that changed since.
+
+typedef struct ProjectUnit {
+    CallGraph* graph;        // Unbuilt; NULL if the file couldn't be read
+    CallGraph* statics;      // The unit's static functions
+    CallIndexBuilder* index; // With an index: the unit's entry, instead of the above
+    int cached;              // Entry in the old index, or -1 if the file has to be read
+} ProjectUnit;
+
+typedef struct Project {
+    CompileCommands* commands;
+    ProjectUnit* units;
+    int* reads;              // Units to read, one task each
+    int indexed;             // Whether units go into an index
+} Project;
+
+void read_project_file(Project* project, int i) {
+    const char* path = project->commands->files[i];
+    LexedSource lexed;
+    long long mtime, size;
+    // The stamp is taken first, so a change made while the file is read shows on the next run
+    if (project->indexed && stampIndexedFile(path, &mtime, &size) && openLexedFile(path, &lexed)) {
+        project->units[i].index = createCallIndexBuilder();
+        indexLexedUnit(project->units[i].index, path, mtime, size, &lexed);
+        closeLexedSource(&lexed);
+    } else if (!project->indexed && openLexedFile(path, &lexed)) {
+        project->units[i].graph = readCallGraph(&lexed);
+        project->units[i].statics = readStaticFunctions(&lexed);
+        closeLexedSource(&lexed);
+    }
+}
+
+void read_project_unit(int task, int worker, void* context) {
+    (void)worker;
+    Project* project = (Project*)context;
+    Stats stats;
+    statsBegin(&stats);
+    read_project_file(project, project->reads[task]);
+    statsEnd(&stats);
+}
+
+// Reads and merges every unit of commands into one built call graph, through
+// the index at index_path unless it is NULL. read is set to the number of units
+// that had to be read rather than taken from the index.
+CallGraph* read_project(CompileCommands* commands, const char* index_path, FindingWriter* writer, int jobs,
+                        int* read) {
+    Project project;
+    project.commands = commands;
+    project.indexed = index_path != NULL;
+    project.units = (ProjectUnit*)calloc(commands->count + 1, sizeof(ProjectUnit));
+    project.reads = (int*)malloc(sizeof(int) * (commands->count + 1));
+    if (project.units == NULL || project.reads == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    CallIndex cache;
+    initCallIndex(&cache);
+    if (index_path != NULL)
+        openCallIndex(index_path, &cache);
+    int readCount = 0;
+    for (int i = 0; i < commands->count; i++) {
+        int f = findIndexedFile(&cache, commands->files[i]);
+        project.units[i].cached = f != -1 && indexedFileIsCurrent(&cache, f, commands->files[i]) ? f : -1;
+        if (project.units[i].cached == -1)
+            project.reads[readCount++] = i;
+    }
+    finishTaskPool(startTaskPool(readCount, jobs, read_project_unit, &project));
+
+    Stats stats;
+    statsBegin(&stats);
+    // A new index is only needed if a unit was read or one has gone
+    CallIndexBuilder* builder = NULL;
+    if (index_path != NULL && (readCount > 0 || cache.fileCount != commands->count))
+        builder = createCallIndexBuilder();
+    CallGraph* graph = createCallGraph();
+    for (int i = 0; i < commands->count; i++) {
+        ProjectUnit* unit = &project.units[i];
+        CallIndex entry;
+        if (unit->cached != -1) {
+            readIndexedUnit(&cache, unit->cached, &unit->graph, &unit->statics);
+            if (builder != NULL)
+                copyIndexedFile(builder, &cache, unit->cached);
+        } else if (unit->index != NULL) {
+            viewCallIndex(unit->index, &entry);
+            readIndexedUnit(&entry, 0, &unit->graph, &unit->statics);
+            copyIndexedFile(builder, &entry, 0);
+            freeCallIndexBuilder(unit->index);
+        } else if (unit->graph == NULL) {
+            writeMessage(writer, "Error opening file: %s\n", commands->files[i]);
+            continue;
+        }
+        mergeUnitCallGraph(graph, unit->graph, unit->statics, addCallGraphFile(graph, commands->files[i]));
+        freeCallGraph(unit->graph);
+        freeCallGraph(unit->statics);
+    }
+    closeCallIndex(&cache);
+    buildCallGraph(graph);
+    if (builder != NULL) {
+        if (!writeCallIndex(builder, index_path))
+            writeMessage(writer, "Could not write index: %s\n", index_path);
+        freeCallIndexBuilder(builder);
+    }
+    *read = readCount;
+    statsEnd(&stats);
+    free(project.units);
+    free(project.reads);
+    return graph;
+}
+
+int run_project(const char* database, const char* index_path, int jobs, OutputFormat format) {
+    CompileCommands commands;
+    if (!loadCompileCommands(database, &commands)) {
+        printf("Could not read compilation database: %s\n", database);
+        return 1;
+    }
+    FindingWriter* writer = (FindingWriter*)malloc(sizeof(FindingWriter));
+    if (writer == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    initFindingWriter(writer, stdout, format, database);
+    if (format == OUTPUT_TEXT)
+        printf("====Bug-Detection in C using C====\n");
+    beginFindings(stdout, format);
+    int read;
+    CallGraph* graph = read_project(&commands, index_path, writer, jobs, &read);
+    if (format == OUTPUT_TEXT) {
+        printf("\nProject call graph: %d file%s, %d functions, %d calls.\n", graph->fileCount,
+               graph->fileCount == 1 ? "" : "s", graph->funcCount, graph->edgeCount);
+        if (index_path != NULL)
+            printf("Index: %d of %d files read, the others unchanged.\n", read, commands.count);
+    }
+    Stats stats;
+    statsBegin(&stats);
+    reportRecursion(graph, writer);
+    flushFindingWriter(writer);
+    statsEnd(&stats);
+    endFindings(stdout, format);
+
+    freeCallGraph(graph);
+    free(writer);
+    freeCompileCommands(&commands);
+    return 0;
+}
+
+// ---- Daemon mode ----
+// test --daemon SOCKET keeps one process running for editor plugins and hooks,
+// so a request pays for neither process startup nor building the keyword
+// matchers, and a file that hasn't changed since it was last asked about costs
+// a cache lookup. Clients connect to the Unix socket and send any number of
+// requests, one per line:
+//   file PATH                  analyse the file on disk (a relative PATH is taken
+//                              from the directory the daemon was started in)
+//   buffer NAME SIZE           analyse the SIZE bytes that follow, the unsaved
+//                              contents of NAME
+//   shutdown                   stop the daemon
+// Each answer is the findings as JSON lines, as --format jsonl writes them,
+// ended by a line {"done":true,...} that says whether the report came from the
+// cache; a request that fails gets a line {"error":...} instead. Reports are
+// cached per name, keyed by the file's identity and modification time, or by a
+// buffer's contents, and the least recently used go first once
+// daemon_cache_limit are kept. What stays warm between requests is the keyword
+// matchers and those reports: a changed file or a new buffer is analysed from
+// scratch, as "test --format jsonl" would, rather than patched from state kept
+// for its old version. A buffer is at most daemon_buffer_limit bytes. Every
+// connection is served on a thread of its own.
+#ifndef _WIN32
+
+#define DAEMON_CACHE_BUCKETS 1024
+int daemon_cache_limit = 4096;   // Reports kept; the least recently used go first
+long daemon_buffer_limit = 64L << 20;
+
+typedef struct CachedReport {
+    char* name;
+    // What the report was made from: a file as stat saw it, or a buffer's contents
+    int from_buffer;
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+    char* contents;
+    size_t contents_size;
+    unsigned int contents_hash;
+    char* report;                // The findings, as JSON lines
+    size_t report_size;
+    int findings;
+    struct CachedReport* next;   // In the same bucket
+    struct CachedReport* newer;  // In order of use
+    struct CachedReport* older;
+} CachedReport;
+
+typedef struct Daemon {
+    int listener;
+    int jobs;
+    int stopping;                // Set by a shutdown request
+    CachedReport* buckets[DAEMON_CACHE_BUCKETS];
+    CachedReport* newest;
+    CachedReport* oldest;
+    int cached;
+    pthread_mutex_t lock;        // Guards the cache and stopping
+} Daemon;
+
+typedef struct Connection {
+    Daemon* server;
+    int fd;
+} Connection;
+
+void free_cached_report(CachedReport* entry) {
+    free(entry->name);
+    free(entry->contents);
+    free(entry->report);
+    free(entry);
+}
+
+CachedReport** find_cached_report(Daemon* server, const char* name) {
+    CachedReport** slot = &server->buckets[hashName(name) % DAEMON_CACHE_BUCKETS];
+    while (*slot != NULL && strcmp((*slot)->name, name) != 0)
+        slot = &(*slot)->next;
+    return slot;
+}
+
+// Takes entry out of the order of use. Call with the lock held.
+void unlink_cached_report(Daemon* server, CachedReport* entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        server->newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        server->oldest = entry->newer;
+    }
+    entry->newer = entry->older = NULL;
+}
+
+// Makes entry the most recently used. Call with the lock held.
+void touch_cached_report(Daemon* server, CachedReport* entry) {
+    if (server->newest == entry)
+        return;
+    if (entry->newer != NULL || entry->older != NULL || server->oldest == entry)
+        unlink_cached_report(server, entry);
+    entry->older = server->newest;
+    if (server->newest != NULL)
+        server->newest->newer = entry;
+    server->newest = entry;
+    if (server->oldest == NULL)
+        server->oldest = entry;
+}
+
+// Drops the entry in slot from the cache. Call with the lock held.
+void remove_cached_report(Daemon* server, CachedReport** slot) {
+    CachedReport* entry = *slot;
+    *slot = entry->next;
+    unlink_cached_report(server, entry);
+    free_cached_report(entry);
+    server->cached--;
+}
+
+// Whether entry was made from what is there now
+int cached_report_matches(const CachedReport* entry, const struct stat* info, const char* contents,
+                          size_t size, unsigned int hash) {
+    if (contents != NULL) {
+        return entry->from_buffer && entry->contents_size == size && entry->contents_hash == hash &&
+               memcmp(entry->contents, contents, size) == 0;
+    }
+    return !entry->from_buffer && entry->device == info->st_dev && entry->inode == info->st_ino &&
+           entry->size == info->st_size && entry->modified.tv_sec == info->st_mtim.tv_sec &&
+           entry->modified.tv_nsec == info->st_mtim.tv_nsec;
+}
+
+// Copies out the cached report for name if it is still current. Returns 0 if there is none.
+int take_cached_report(Daemon* server, const char* name, const struct stat* info, const char* contents,
+                       size_t size, unsigned int hash, char** report, size_t* report_size, int* findings) {
+    int found = 0;
+    pthread_mutex_lock(&server->lock);
+    CachedReport* entry = *find_cached_report(server, name);
+    if (entry != NULL && cached_report_matches(entry, info, contents, size, hash)) {
+        *report = (char*)malloc(entry->report_size + 1);
+        if (*report == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        memcpy(*report, entry->report, entry->report_size);
+        *report_size = entry->report_size;
+        *findings = entry->findings;
+        touch_cached_report(server, entry);
+        found = 1;
+    }
+    pthread_mutex_unlock(&server->lock);
+    return found;
+}
+
+// Keeps entry as the report for its name, in place of any older one.
+void store_cached_report(Daemon* server, CachedReport* entry) {
+    pthread_mutex_lock(&server->lock);
+    CachedReport** slot = find_cached_report(server, entry->name);
+    if (*slot != NULL)
+        remove_cached_report(server, slot);
+    if (server->cached >= daemon_cache_limit && server->oldest != NULL)
+        remove_cached_report(server, find_cached_report(server, server->oldest->name));
+    slot = find_cached_report(server, entry->name);
+    entry->next = *slot;
+    *slot = entry;
+    touch_cached_report(server, entry);
+    server->cached++;
+    pthread_mutex_unlock(&server->lock);
+}
+
+// Analyses lexed source into a new cache entry for name.
+CachedReport* make_report(Daemon* server, const char* name, const LexedSource* lexed) {
+    CachedReport* entry = (CachedReport*)calloc(1, sizeof(CachedReport));
+    FindingWriter* writer = (FindingWriter*)malloc(sizeof(FindingWriter));
+    if (entry == NULL || writer == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    entry->name = copyString(name);
+    FILE* out = open_memstream(&entry->report, &entry->report_size);
+    if (out == NULL) {
+        printf("Could not create report buffer.\n");
+        exit(1);
+    }
+    initFindingWriter(writer, out, OUTPUT_JSONL, entry->name);
+    analyse_lexed(lexed, entry->name, writer, server->jobs);
+    flushFindingWriter(writer);
+    fclose(out);
+    entry->findings = writer->count;
+    free(writer);
+    return entry;
+}
+
+// Answers with the findings and the closing status line, or with an error line.
+void send_report(FindingWriter* reply, const char* name, const char* report, size_t size, int findings,
+                 int cached, double started) {
+    char number[64];
+    writeRaw(reply, report, size);
+    writeText(reply, "{\"done\":true,\"file\":");
+    writeJsonString(reply, name);
+    snprintf(number, sizeof(number), ",\"findings\":%d,\"cached\":%s,\"time_ms\":%.3f}\n",
+             findings, cached ? "true" : "false", (statsNow() - started) * 1000);
+    writeText(reply, number);
+    flushFindingWriter(reply);
+}
+
+void send_error(FindingWriter* reply, const char* message, const char* name) {
+    writeText(reply, "{\"error\":");
+    writeJsonString(reply, message);
+    if (name != NULL) {
+        writeText(reply, ",\"file\":");
+        writeJsonString(reply, name);
+    }
+    writeText(reply, "}\n");
+    flushFindingWriter(reply);
+}
+
+// contents is NULL for a file on disk, the bytes to analyse for a buffer.
+void serve_request(Daemon* server, FindingWriter* reply, const char* name, const char* contents, size_t size) {
+    double started = statsNow();
+    struct stat info;
+    unsigned int hash = 0;
+    if (contents != NULL) {
+        hash = hashNameLength(contents, (int)size);
+    } else if (stat(name, &info) != 0 || !S_ISREG(info.st_mode)) {
+        send_error(reply, "cannot access file", name);
+        return;
+    }
+
+    char* report;
+    size_t report_size;
+    int findings;
+    if (take_cached_report(server, name, &info, contents, size, hash, &report, &report_size, &findings)) {
+        send_report(reply, name, report, report_size, findings, 1, started);
+        free(report);
+        return;
+    }
+
+    LexedSource lexed;
+    if (contents != NULL) {
+        lexCopy(&lexed, contents, size, 1);
+    } else if (!openLexedFile(name, &lexed)) {
+        send_error(reply, "cannot read file", name);
+        return;
+    }
+    CachedReport* entry = make_report(server, name, &lexed);
+    closeLexedSource(&lexed);
+    if (contents != NULL) {
+        entry->from_buffer = 1;
+        entry->contents = (char*)malloc(size + 1);
+        if (entry->contents == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        memcpy(entry->contents, contents, size);
+        entry->contents_size = size;
+        entry->contents_hash = hash;
+    } else {
+        entry->device = info.st_dev;
+        entry->inode = info.st_ino;
+        entry->size = info.st_size;
+        entry->modified = info.st_mtim;
+    }
+    send_report(reply, name, entry->report, entry->report_size, entry->findings, 0, started);
+    store_cached_report(server, entry);
+}
+
+void* serve_connection(void* arg) {
+    Connection* connection = (Connection*)arg;
+    Daemon* server = connection->server;
+    FILE* in = fdopen(connection->fd, "r");
+    FILE* out = fdopen(dup(connection->fd), "w");
+    FindingWriter* reply = (FindingWriter*)malloc(sizeof(FindingWriter));
+    if (in == NULL || out == NULL || reply == NULL) {
+        printf("Could not serve connection.\n");
+        exit(1);
+    }
+    initFindingWriter(reply, out, OUTPUT_JSONL, NULL);
+
+    char* line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+    while ((length = getline(&line, &line_capacity, in)) > 0) {
+        if (line[length - 1] == '\n')
+            line[--length] = '\0';
+        if (strncmp(line, "file ", 5) == 0) {
+            serve_request(server, reply, line + 5, NULL, 0);
+        } else if (strncmp(line, "buffer ", 7) == 0) {
+            // The name may have spaces in it; the size is the last word
+            char* space = strrchr(line + 7, ' ');
+            char* end = NULL;
+            long size = space != NULL ? strtol(space + 1, &end, 10) : -1;
+            if (space == NULL || space == line + 7 || *end != '\0' || size < 0) {
+                send_error(reply, "expected: buffer NAME SIZE", NULL);
+                break;
+            }
+            if (size > daemon_buffer_limit) {
+                // Its contents are never read, so the connection can't go on
+                char message[64];
+                snprintf(message, sizeof(message), "buffer larger than %ld bytes", daemon_buffer_limit);
+                *space = '\0';
+                send_error(reply, message, line + 7);
+                break;
+            }
+            *space = '\0';
+            char* contents = (char*)malloc(size + 1);
+            if (contents == NULL) {
+                printf("Memory allocation failed!\n");
+                exit(1);
+            }
+            if (fread(contents, 1, size, in) != (size_t)size) {
+                free(contents);
+                break;
+            }
+            serve_request(server, reply, line + 7, contents, size);
+            free(contents);
+        } else if (strcmp(line, "shutdown") == 0) {
+            pthread_mutex_lock(&server->lock);
+            server->stopping = 1;
+            pthread_mutex_unlock(&server->lock);
+            shutdown(server->listener, SHUT_RDWR);
+            break;
+        } else if (length > 0) {
+            send_error(reply, "unknown request", NULL);
+        }
+    }
+    free(line);
+    free(reply);
+    fclose(in);
+    fclose(out);
+    free(connection);
+    return NULL;
+}
+
+// Serves requests on the Unix socket at path until asked to shut down. Returns
+// the exit status.
+int run_daemon(const char* path, int jobs) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("Socket path too long: %s\n", path);
+        return 1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    Daemon* server = (Daemon*)calloc(1, sizeof(Daemon));
+    if (server == NULL) {
+        printf("Memory allocation failed!\n");
+        return 1;
+    }
+    server->jobs = jobs;
+    pthread_mutex_init(&server->lock, NULL);
+    server->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    // A socket file left behind by a daemon that didn't shut down is reused, but
+    // not one a running daemon still accepts connections on
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        int live = probe >= 0 && connect(probe, (struct sockaddr*)&address, sizeof(address)) == 0;
+        if (probe >= 0)
+            close(probe);
+        if (live) {
+            printf("A daemon is already listening on %s\n", path);
+            return 1;
+        }
+        unlink(path);
+    }
+    // The socket is created owner-only, so no other user can connect in between
+    mode_t mask = umask(0177);
+    int bound = server->listener >= 0 && bind(server->listener, (struct sockaddr*)&address, sizeof(address)) == 0;
+    umask(mask);
+    if (!bound || listen(server->listener, 64) != 0) {
+        printf("Cannot listen on %s\n", path);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN); // A client that hangs up early only ends its own connection
+
+    // Everything shared between requests is built before the first one
+    init_semicolon_matcher();
+    pthread_once(&lexClassOnce, initLexClasses);
+    printf("Listening on %s\n", path);
+    fflush(stdout);
+
+    for (;;) {
+        int fd = accept(server->listener, NULL, NULL);
+        pthread_mutex_lock(&server->lock);
+        int stopping = server->stopping;
+        pthread_mutex_unlock(&server->lock);
+        if (stopping) {
+            if (fd >= 0)
+                close(fd);
+            break;
+        }
+        if (fd < 0)
+            continue;
+        Connection* connection = (Connection*)malloc(sizeof(Connection));
+        if (connection == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        connection->server = server;
+        connection->fd = fd;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serve_connection, connection) != 0) {
+            printf("Could not start connection thread.\n");
+            exit(1);
+        }
+        pthread_detach(thread);
+    }
+    // Connections still being served keep using the cache until the process exits
+    close(server->listener);
+    unlink(path);
+    return 0;
+}
+#endif
+
+// ---- Watch mode ----
+// test --watch DIR analyses every .c/.h file under DIR, then waits on inotify for
+// files to be written, created, renamed or deleted, and prints how their
+// findings changed: new ones and resolved ones. Nothing is polled, and only the
+// files an event names are read again. When a directory is deleted or moved
+// away, the files that were under it are reported resolved. A changed file is
+// analysed whole, as "test --format jsonl FILE" would, so the findings watch
+// mode reports are the ones a run over the file gives. Events are collected until none has come for
+// watch_debounce_ms, so an editor's burst of writes, or a checkout touching
+// hundreds of files, is handled in one go. A finding is matched against the
+// file's previous findings by rule, severity and message with the numbers taken
+// out, so findings that only moved because lines were added above them are
+// neither new nor resolved.
+#ifdef __linux__
+
+int watch_debounce_ms = 100;
+#define WATCH_MAX_WAIT_MS 1000   // Report a steady stream of events at least this often
+#define WATCH_BUCKETS 4096
+
+typedef struct WatchedFile {
+    char* path;
+    FindingList findings;        // The findings last reported
+    FindingList previous;        // Until the diff is printed
+    int exists;                  // Whether the last update could read the file
+    struct WatchedFile* next;    // In the same bucket
+} WatchedFile;
+
+typedef struct Watch {
+    int inotify;
+    char** directories;          // By watch descriptor; NULL for none
+    int directory_capacity;
+    WatchedFile* buckets[WATCH_BUCKETS];
+    int file_count;
+} Watch;
+
+WatchedFile* find_watched_file(Watch* watch, const char* path, int create) {
+    WatchedFile** slot = &watch->buckets[hashName(path) % WATCH_BUCKETS];
+    while (*slot != NULL && strcmp((*slot)->path, path) != 0)
+        slot = &(*slot)->next;
+    if (*slot == NULL && create) {
+        WatchedFile* file = (WatchedFile*)calloc(1, sizeof(WatchedFile));
+        if (file == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        file->path = copyString(path);
+        *slot = file;
+        watch->file_count++;
+    }
+    return *slot;
+}
+
+// Watches directory and every directory under it.
+void watch_directory(Watch* watch, const char* directory) {
+    int wd = inotify_add_watch(watch->inotify, directory,
+                               IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE |
+                               IN_DELETE_SELF | IN_ONLYDIR);
+    if (wd < 0) {
+        printf("Cannot watch %s\n", directory);
+        return;
+    }
+    if (wd >= watch->directory_capacity) {
+        int capacity = watch->directory_capacity ? watch->directory_capacity : 64;
+        while (capacity <= wd)
+            capacity *= 2;
+        watch->directories = (char**)realloc(watch->directories, sizeof(char*) * capacity);
+        if (watch->directories == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        memset(watch->directories + watch->directory_capacity, 0,
+               sizeof(char*) * (capacity - watch->directory_capacity));
+        watch->directory_capacity = capacity;
+    }
+    free(watch->directories[wd]);
+    watch->directories[wd] = copyString(directory);
+
+    DIR* dir = opendir(directory);
+    if (dir == NULL)
+        return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        size_t len = strlen(directory) + strlen(entry->d_name) + 2;
+        char* child = (char*)malloc(len);
+        if (child == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        snprintf(child, len, "%s/%s", directory, entry->d_name);
+        struct stat info;
+        if (stat(child, &info) == 0 && S_ISDIR(info.st_mode))
+            watch_directory(watch, child);
+        free(child);
+    }
+    closedir(dir);
+}
+
+// Brings a file's findings up to date, keeping the ones it had in previous.
+void update_watched_file(WatchedFile* file) {
+    freeFindingList(&file->previous);
+    file->previous = file->findings;
+    memset(&file->findings, 0, sizeof(FindingList));
+    LexedSource lexed;
+    file->exists = openLexedFile(file->path, &lexed);
+    if (!file->exists)
+        return;
+    FindingWriter* writer = record_writer(file->path, &file->findings);
+    analyse_lexed(&lexed, file->path, writer, 1);
+    free(writer);
+    closeLexedSource(&lexed);
+}
+
+void update_watched_task(int task, int worker, void* context) {
+    (void)worker;
+    update_watched_file(((WatchedFile**)context)[task]);
+}
+
+// What a finding is matched on between two versions of a file
+typedef struct Fingerprint {
+    char* key;
+    int index;
+} Fingerprint;
+
+int compare_fingerprints(const void* a, const void* b) {
+    const Fingerprint* x = (const Fingerprint*)a;
+    const Fingerprint* y = (const Fingerprint*)b;
+    int order = strcmp(x->key, y->key);
+    return order != 0 ? order : x->index - y->index;
+}
+
+Fingerprint* fingerprint_findings(const FindingList* list) {
+    Fingerprint* prints = (Fingerprint*)malloc(sizeof(Fingerprint) * (list->count + 1));
+    if (prints == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (int i = 0; i < list->count; i++) {
+        const Finding* finding = &list->items[i];
+        char* key = (char*)malloc(strlen(finding->rule) + strlen(finding->message) + 4);
+        if (key == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        int len = sprintf(key, "%s\x1f%d\x1f", finding->rule, (int)finding->severity);
+        for (const char* p = finding->message; *p; p++) {
+            if (!isdigit((unsigned char)*p))
+                key[len++] = *p;
+        }
+        key[len] = '\0';
+        prints[i].key = key;
+        prints[i].index = i;
+    }
+    qsort(prints, list->count, sizeof(Fingerprint), compare_fingerprints);
+    return prints;
+}
+
+void print_finding_change(const char* mark, const Finding* finding) {
+    printf("  %s line %d: %s: %s\n", mark, finding->line,
+           finding->severity == SEVERITY_ERROR ? "Error" : "Warning", finding->message);
+}
+
+// Prints what changed between a file's previous and current findings. Returns
+// the number of changes.
+int print_finding_changes(WatchedFile* file) {
+    FindingList* before = &file->previous;
+    FindingList* after = &file->findings;
+    Fingerprint* old_prints = fingerprint_findings(before);
+    Fingerprint* new_prints = fingerprint_findings(after);
+    char* kept_before = (char*)calloc(before->count + 1, 1);
+    char* kept_after = (char*)calloc(after->count + 1, 1);
+    if (kept_before == NULL || kept_after == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    // Both sorted by key: walk them together, pairing equal keys
+    int resolved = before->count, added = after->count;
+    for (int i = 0, j = 0; i < before->count && j < after->count; ) {
+        int order = strcmp(old_prints[i].key, new_prints[j].key);
+        if (order == 0) {
+            kept_before[old_prints[i++].index] = 1;
+            kept_after[new_prints[j++].index] = 1;
+            resolved--;
+            added--;
+        } else if (order < 0) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+
+    if (resolved + added > 0) {
+        printf("%s: %d new, %d resolved%s\n", file->path, added, resolved, file->exists ? "" : " (removed)");
+        for (int i = 0; i < before->count; i++) {
+            if (!kept_before[i])
+                print_finding_change("-", &before->items[i]);
+        }
+        for (int j = 0; j < after->count; j++) {
+            if (!kept_after[j])
+                print_finding_change("+", &after->items[j]);
+        }
+    }
+    for (int i = 0; i < before->count; i++)
+        free(old_prints[i].key);
+    for (int j = 0; j < after->count; j++)
+        free(new_prints[j].key);
+    free(old_prints);
+    free(new_prints);
+    free(kept_before);
+    free(kept_after);
+    freeFindingList(before);
+    return resolved + added;
+}
+
+// Drops a file that no longer exists, once its findings have been reported resolved.
+void forget_watched_file(Watch* watch, WatchedFile* file) {
+    WatchedFile** slot = &watch->buckets[hashName(file->path) % WATCH_BUCKETS];
+    while (*slot != file)
+        slot = &(*slot)->next;
+    *slot = file->next;
+    freeFindingList(&file->findings);
+    free(file->path);
+    free(file);
+    watch->file_count--;
+}
+
+// Re-analyses the files in changed, on jobs threads, and prints their changes
+// in path order.
+void update_watched_files(SourceList* changed, Watch* watch, int jobs) {
+    if (changed->count == 0)
+        return;
+    qsort(changed->paths, changed->count, sizeof(char*), compare_names);
+    WatchedFile** files = (WatchedFile**)malloc(sizeof(WatchedFile*) * (changed->count + 1));
+    if (files == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (int i = 0; i < changed->count; i++)
+        files[i] = find_watched_file(watch, changed->paths[i], 1);
+    if (jobs > 1 && changed->count > 1) {
+        TaskPool* pool = startTaskPool(changed->count, jobs, update_watched_task, files);
+        finishTaskPool(pool);
+    } else {
+        for (int i = 0; i < changed->count; i++)
+            update_watched_file(files[i]);
+    }
+    for (int i = 0; i < changed->count; i++) {
+        print_finding_changes(files[i]);
+        if (!files[i]->exists)
+            forget_watched_file(watch, files[i]);
+    }
+    fflush(stdout);
+    free(files);
+}
+
+// The files a burst of events named, each once
+typedef struct ChangedSources {
+    SourceList list;
+    int* slots;                  // Index in list + 1, or 0; open addressing by path hash
+    int capacity;                // Always a power of two
+} ChangedSources;
+
+int* find_changed_slot(ChangedSources* changed, const char* path) {
+    int slot = (int)(hashName(path) & (unsigned int)(changed->capacity - 1));
+    while (changed->slots[slot] != 0 && strcmp(changed->list.paths[changed->slots[slot] - 1], path) != 0)
+        slot = (slot + 1) & (changed->capacity - 1);
+    return &changed->slots[slot];
+}
+
+// Adds path to changed unless it is there already.
+void add_changed_source(ChangedSources* changed, const char* path) {
+    if ((changed->list.count + 1) * 2 > changed->capacity) {
+        free(changed->slots);
+        changed->capacity = changed->capacity ? changed->capacity * 2 : 256;
+        changed->slots = (int*)calloc(changed->capacity, sizeof(int));
+        if (changed->slots == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        for (int i = 0; i < changed->list.count; i++)
+            *find_changed_slot(changed, changed->list.paths[i]) = i + 1;
+    }
+    int* slot = find_changed_slot(changed, path);
+    if (*slot != 0)
+        return;
+    add_source(&changed->list, path);
+    *slot = changed->list.count;
+}
+
+void clear_changed_sources(ChangedSources* changed) {
+    for (int i = 0; i < changed->list.count; i++)
+        free(changed->list.paths[i]);
+    changed->list.count = 0;
+    if (changed->slots != NULL)
+        memset(changed->slots, 0, sizeof(int) * changed->capacity);
+}
+
+// A watched directory has been deleted or moved away: stops watching it and
+// the directories under it, and adds the files known under it to changed, so
+// their findings are reported resolved.
+void drop_watched_directory(Watch* watch, const char* path, ChangedSources* changed) {
+    char* directory = copyString(path);  // path may be one of the names freed below
+    size_t len = strlen(directory);
+    for (int b = 0; b < WATCH_BUCKETS; b++) {
+        for (WatchedFile* file = watch->buckets[b]; file != NULL; file = file->next) {
+            if (file->exists && strncmp(file->path, directory, len) == 0 && file->path[len] == '/')
+                add_changed_source(changed, file->path);
+        }
+    }
+    for (int wd = 0; wd < watch->directory_capacity; wd++) {
+        const char* name = watch->directories[wd];
+        if (name != NULL && strncmp(name, directory, len) == 0 && (name[len] == '\0' || name[len] == '/')) {
+            inotify_rm_watch(watch->inotify, wd);
+            free(watch->directories[wd]);
+            watch->directories[wd] = NULL;
+        }
+    }
+    free(directory);
+}
+
+// Reads the events waiting on the inotify descriptor, adding the source files
+// they name to changed. Returns 0 if the queue overflowed and events were lost.
+int read_watch_events(Watch* watch, ChangedSources* changed) {
+    char buffer[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length = read(watch->inotify, buffer, sizeof(buffer));
+    int complete = 1;
+    for (char* p = buffer; length > 0 && p < buffer + length; ) {
+        struct inotify_event* event = (struct inotify_event*)p;
+        p += sizeof(struct inotify_event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW) {
+            complete = 0;
+            continue;
+        }
+        if (event->wd < 0 || event->wd >= watch->directory_capacity || watch->directories[event->wd] == NULL)
+            continue;
+        const char* directory = watch->directories[event->wd];
+        if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+            drop_watched_directory(watch, directory, changed);
+            continue;
+        }
+        if (event->len == 0)
+            continue;
+        size_t len = strlen(directory) + strlen(event->name) + 2;
+        char* path = (char*)malloc(len);
+        if (path == NULL) {
+            printf("Memory allocation failed!\n");
+            exit(1);
+        }
+        snprintf(path, len, "%s/%s", directory, event->name);
+        if (event->mask & IN_ISDIR) {
+            // A new directory may already have files in it by the time it is watched
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                watch_directory(watch, path);
+                SourceList sources = {NULL, 0, 0};
+                collect_sources(&sources, path);
+                for (int i = 0; i < sources.count; i++) {
+                    add_changed_source(changed, sources.paths[i]);
+                    free(sources.paths[i]);
+                }
+                free(sources.paths);
+            } else if (event->mask & (IN_MOVED_FROM | IN_DELETE)) {
+                // A directory moved away keeps its watch under the old name
+                drop_watched_directory(watch, path, changed);
+            }
+        } else if (is_c_source(event->name) && !(event->mask & IN_CREATE)) {
+            // A created file is picked up when it is closed after writing
+            add_changed_source(changed, path);
+        }
+        free(path);
+    }
+    return complete;
+}
+
+// Every file seen so far and every file now under directory, with any
+// directory not watched yet watched, for a full rescan after lost events
+void add_all_watched(Watch* watch, const char* directory, ChangedSources* changed) {
+    for (int b = 0; b < WATCH_BUCKETS; b++) {
+        for (WatchedFile* file = watch->buckets[b]; file != NULL; file = file->next) {
+            if (file->exists)
+                add_changed_source(changed, file->path);
+        }
+    }
+    watch_directory(watch, directory);
+    SourceList sources = {NULL, 0, 0};
+    collect_sources(&sources, directory);
+    for (int i = 0; i < sources.count; i++) {
+        add_changed_source(changed, sources.paths[i]);
+        free(sources.paths[i]);
+    }
+    free(sources.paths);
+}
+
+// Watches directory until killed. Returns the exit status if it can't start.
+int run_watch(const char* directory, int jobs) {
+    Watch watch;
+    memset(&watch, 0, sizeof(watch));
+    watch.inotify = inotify_init1(IN_CLOEXEC);
+    if (watch.inotify < 0) {
+        printf("Cannot start inotify.\n");
+        return 1;
+    }
+    struct stat info;
+    if (stat(directory, &info) != 0 || !S_ISDIR(info.st_mode)) {
+        printf("Error: %s is not a directory\n", directory);
+        return 1;
+    }
+    init_semicolon_matcher();
+
+    // Watch first, so nothing written during the first analysis is missed
+    watch_directory(&watch, directory);
+    SourceList sources = {NULL, 0, 0};
+    collect_sources(&sources, directory);
+    WatchedFile** files = (WatchedFile**)malloc(sizeof(WatchedFile*) * (sources.count + 1));
+    if (files == NULL) {
+        printf("Memory allocation failed!\n");
+        exit(1);
+    }
+    for (int i = 0; i < sources.count; i++)
+        files[i] = find_watched_file(&watch, sources.paths[i], 1);
+    TaskPool* pool = startTaskPool(sources.count, jobs, update_watched_task, files);
+    finishTaskPool(pool);
+    int findings = 0;
+    for (int i = 0; i < sources.count; i++) {
+        freeFindingList(&files[i]->previous);
+        findings += files[i]->findings.count;
+        free(sources.paths[i]);
+    }
+    free(files);
+    free(sources.paths);
+    printf("Watching %d file%s under %s, %d finding%s.\n", watch.file_count, watch.file_count == 1 ? "" : "s",
+           directory, findings, findings == 1 ? "" : "s");
+    fflush(stdout);
+
+    ChangedSources changed = {{NULL, 0, 0}, NULL, 0};
+    struct pollfd waiting = {watch.inotify, POLLIN, 0};
+    for (;;) {
+        if (poll(&waiting, 1, -1) < 0)
+            continue;
+        // Gather events until they stop coming for a moment
+        double first = statsNow();
+        int complete = read_watch_events(&watch, &changed);
+        while (poll(&waiting, 1, watch_debounce_ms) > 0 && (statsNow() - first) * 1000 < WATCH_MAX_WAIT_MS)
+            complete &= read_watch_events(&watch, &changed);
+        if (!complete) {
+            printf("Events were lost; checking every file again.\n");
+            add_all_watched(&watch, directory, &changed);
+        }
+        update_watched_files(&changed.list, &watch, jobs);
+        clear_changed_sources(&changed);
+    }
+}
+#endif
+
+#ifndef BUGFIXER_NO_MAIN
+// Usage: test [-j N] [--format text|jsonl|sarif]             analyse testcase.txt, its detectors on up to N threads
+//        test [-j N] [--format text|jsonl|sarif] PATH...     analyse files and directory trees on N threads
+//        test [-j N] [--format text|jsonl|sarif] --project compile_commands.json [--index FILE]
+//                                                            find recursion across a project (see Project mode)
+//        test [-j N] --daemon SOCKET                         serve requests on a Unix socket (see Daemon mode)
+//        test [-j N] --watch DIR                             report findings as files under DIR change
+// -I DIR (repeatable) and --follow-includes have the first two forms read the
+// headers a file includes, "name" from its own directory or DIR and <name> from
+// DIR, so the types, allocators and out-parameters they declare are known.
+int main(int argc, char* argv[]) {
+    int jobs = default_jobs();
+    OutputFormat format = OUTPUT_TEXT;
+    SourceList sources = {NULL, 0, 0};
+    SourceList arguments = {NULL, 0, 0};
+    int stats_json = 0;
+    const char* daemon_socket = NULL;
+    const char* project_database = NULL;
+    const char* project_index = NULL;
+    const char* watch_directory_path = NULL;
+    SourceList include_paths = {NULL, 0, 0};
+    int follow_includes = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs < 1) {
+                printf("Invalid job count: %s\n", argv[i]);
+                return 1;
+            }
+        } else if ((strcmp(argv[i], "--format") == 0 && i + 1 < argc) || strncmp(argv[i], "--format=", 9) == 0) {
+            const char* name = argv[i][8] == '=' ? argv[i] + 9 : argv[++i];
+            if (!parseOutputFormat(name, &format)) {
+                printf("Unknown output format: %s (expected text, jsonl or sarif)\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=table") == 0) {
+            statsEnabled = 1;
+        } else if (strcmp(argv[i], "--project") == 0 && i + 1 < argc) {
+            project_database = argv[++i];
+        } else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+            project_index = argv[++i];
+        } else if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) {
+            daemon_socket = argv[++i];
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            watch_directory_path = argv[++i];
+        } else if ((strcmp(argv[i], "-I") == 0 && i + 1 < argc) || (strncmp(argv[i], "-I", 2) == 0 && argv[i][2] != '\0')) {
+            add_source(&include_paths, argv[i][2] != '\0' ? argv[i] + 2 : argv[++i]);
+            follow_includes = 1;
+        } else if (strcmp(argv[i], "--follow-includes") == 0) {
+            follow_includes = 1;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            statsEnabled = 1;
+            stats_json = 1;
+        } else {
+            add_source(&arguments, argv[i]);
+        }
+    }
+
+    // Files and directories named on the command line are taken in sorted order
+    // too, so the report doesn't depend on how they were listed
+    if (arguments.count > 1)
+        qsort(arguments.paths, arguments.count, sizeof(char*), compare_names);
+    for (int i = 0; i < arguments.count; i++) {
+        collect_sources(&sources, arguments.paths[i]);
+        free(arguments.paths[i]);
+    }
+    free(arguments.paths);
+
+    if (follow_includes && (project_database != NULL || daemon_socket != NULL || watch_directory_path != NULL)) {
+        printf("-I and --follow-includes apply to file analysis only, not --project, --daemon or --watch.\n");
+        for (int i = 0; i < include_paths.count; i++)
+            free(include_paths.paths[i]);
+        free(include_paths.paths);
+        return 1;
+    }
+    if (project_database != NULL) {
+        int status = run_project(project_database, project_index, jobs, format);
+        if (statsEnabled)
+            printStats(stderr, stats_json);
+        return status;
+    }
+    if (daemon_socket != NULL) {
+#ifndef _WIN32
+        return run_daemon(daemon_socket, jobs);
+#else
+        printf("Daemon mode needs Unix domain sockets.\n");
+        return 1;
+#endif
+    }
+    if (watch_directory_path != NULL) {
+#ifdef __linux__
+        return run_watch(watch_directory_path, jobs);
+#else
+        printf("Watch mode needs inotify.\n");
+        return 1;
+#endif
+    }
+    if (follow_includes) {
+        include_cache = createHeaderCache();
+        for (int i = 0; i < include_paths.count; i++) {
+            addHeaderSearchPath(include_cache, include_paths.paths[i]);
+            free(include_paths.paths[i]);
+        }
+        free(include_paths.paths);
+    }
+
+    if (arguments.count == 0) {
+        FindingWriter* writer = (FindingWriter*)malloc(sizeof(FindingWriter));
+        if (writer == NULL) {
+            printf("Memory allocation failed!\n");
+            return 1;
+        }
+        initFindingWriter(writer, stdout, format, "testcase.txt");
+        if (format == OUTPUT_TEXT)
+            printf("====Bug-Detection in C using C====\n");
+        beginFindings(stdout, format);
+        Stats stats;
+        statsBegin(&stats);
+        analyse_file("testcase.txt", writer, jobs);
+        statsEnd(&stats);
+        endFindings(stdout, format);
+        free(writer);
+        if (include_cache != NULL)
+            freeHeaderCache(include_cache);
+        if (statsEnabled)
+            printStats(stderr, stats_json);
+        return 0;
+    }
+    if (sources.count == 0) {
+        printf("No C files to analyse.\n");
+        if (include_cache != NULL)
+            freeHeaderCache(include_cache);
+        return 1;
+    }
+
+    if (format == OUTPUT_TEXT)
+        printf("====Bug-Detection in C using C====\n");
+    beginFindings(stdout, format);
+    analyse_batch(&sources, jobs, format);
+    endFindings(stdout, format);
+    if (format == OUTPUT_TEXT) {
+        printf("\nAnalysed %d file%s.\n", sources.count, sources.count == 1 ? "" : "s");
+        if (include_cache != NULL)
+            printf("Read %d header%s once each.\n", include_cache->readCount, include_cache->readCount == 1 ? "" : "s");
+    }
+    if (statsEnabled)
+        printStats(stderr, stats_json);
+
+    for (int i = 0; i < sources.count; i++)
+        free(sources.paths[i]);
+    free(sources.paths);
+    if (include_cache != NULL)
+        freeHeaderCache(include_cache);
+    return 0;
+}
+#endif